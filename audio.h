@@ -0,0 +1,291 @@
+#ifndef AUDIO_H
+#define AUDIO_H
+
+// Sound effects with a lock-free mixer.
+//
+// Every sample is decoded to mono float at the device rate when it is loaded.
+// The game thread posts play/stop commands into a single-producer
+// single-consumer ring; the SDL audio callback drains the ring at the start of
+// each buffer and mixes the active voices. The callback never allocates, locks
+// or calls back into the game, so added latency is at most one device buffer
+// (AUDIO_BUFFER_FRAMES / AUDIO_FREQUENCY, about 5 ms).
+
+#include <SDL2/SDL.h>
+#include <iostream>
+#include <math.h>
+#include <string.h>
+#include <stdlib.h>
+
+#define AUDIO_FREQUENCY 48000
+#define AUDIO_BUFFER_FRAMES 256
+#define AUDIO_MAX_SAMPLES 8
+#define AUDIO_MAX_VOICES 16
+#define AUDIO_QUEUE_SIZE 64         // power of two
+#define AUDIO_CMD_PLAY 1
+#define AUDIO_CMD_STOP 2
+
+typedef struct {
+    float* data;            // mono, AUDIO_FREQUENCY
+    int length;
+} AudioSample;
+
+typedef struct {
+    int type;
+    int sample;
+    float volume;
+} AudioCommand;
+
+typedef struct {
+    int sample;             // -1 when the voice is free
+    int position;
+    float volume;
+} AudioVoice;
+
+typedef struct {
+    SDL_AudioDeviceID device;
+    AudioSample samples[AUDIO_MAX_SAMPLES];
+    int numSamples;
+
+    AudioCommand queue[AUDIO_QUEUE_SIZE];
+    SDL_atomic_t head;      // next command to read, advanced by the audio thread
+    SDL_atomic_t tail;      // next free slot, advanced by the game thread
+
+    // Audio thread only; read once the device is closed
+    AudioVoice voices[AUDIO_MAX_VOICES];
+    int callbacks;
+    Uint64 totalCallbackNs;
+    Uint64 maxCallbackNs;
+
+    int droppedCommands;
+} AudioEngine;
+
+inline void audioMix(void* userdata, Uint8* stream, int length) {
+    Uint64 begin = SDL_GetPerformanceCounter();
+    AudioEngine* audio = (AudioEngine*)userdata;
+    float* out = (float*)stream;
+    int frames = length / (int)sizeof(float);
+
+    int head = SDL_AtomicGet(&audio->head);
+    int tail = SDL_AtomicGet(&audio->tail);
+    for (; head != tail; ++head) {
+        const AudioCommand* command = &audio->queue[head & (AUDIO_QUEUE_SIZE - 1)];
+        if (command->type == AUDIO_CMD_PLAY) {
+            // Take a free voice, or steal the one closest to finishing
+            int best = 0;
+            int bestRemaining = 0x7FFFFFFF;
+            for (int v = 0; v < AUDIO_MAX_VOICES; ++v) {
+                AudioVoice* voice = &audio->voices[v];
+                int remaining = voice->sample < 0 ? -1 : audio->samples[voice->sample].length - voice->position;
+                if (remaining < bestRemaining) {
+                    best = v;
+                    bestRemaining = remaining;
+                }
+            }
+            audio->voices[best].sample = command->sample;
+            audio->voices[best].position = 0;
+            audio->voices[best].volume = command->volume;
+        } else if (command->type == AUDIO_CMD_STOP) {
+            for (int v = 0; v < AUDIO_MAX_VOICES; ++v) {
+                if (audio->voices[v].sample == command->sample) {
+                    audio->voices[v].sample = -1;
+                }
+            }
+        }
+    }
+    SDL_AtomicSet(&audio->head, head);
+
+    memset(out, 0, frames * sizeof(float));
+    for (int v = 0; v < AUDIO_MAX_VOICES; ++v) {
+        AudioVoice* voice = &audio->voices[v];
+        if (voice->sample < 0) {
+            continue;
+        }
+        const AudioSample* sample = &audio->samples[voice->sample];
+        int count = sample->length - voice->position;
+        if (count > frames) {
+            count = frames;
+        }
+        const float* source = sample->data + voice->position;
+        for (int i = 0; i < count; ++i) {
+            out[i] += source[i] * voice->volume;
+        }
+        voice->position += count;
+        if (voice->position >= sample->length) {
+            voice->sample = -1;
+        }
+    }
+
+    for (int i = 0; i < frames; ++i) {
+        if (out[i] > 1.0f) {
+            out[i] = 1.0f;
+        } else if (out[i] < -1.0f) {
+            out[i] = -1.0f;
+        }
+    }
+
+    Uint64 elapsed = (SDL_GetPerformanceCounter() - begin) * 1000000000ull / SDL_GetPerformanceFrequency();
+    audio->callbacks++;
+    audio->totalCallbackNs += elapsed;
+    if (elapsed > audio->maxCallbackNs) {
+        audio->maxCallbackNs = elapsed;
+    }
+}
+
+// Opens the output device. Returns false (and leaves the engine silent) if
+// there is no usable audio device; every other call is then a no-op.
+inline bool audioOpen(AudioEngine* audio) {
+    memset(audio, 0, sizeof(*audio));
+    for (int v = 0; v < AUDIO_MAX_VOICES; ++v) {
+        audio->voices[v].sample = -1;
+    }
+
+    SDL_AudioSpec want;
+    memset(&want, 0, sizeof(want));
+    want.freq = AUDIO_FREQUENCY;
+    want.format = AUDIO_F32SYS;
+    want.channels = 1;
+    want.samples = AUDIO_BUFFER_FRAMES;
+    want.callback = audioMix;
+    want.userdata = audio;
+
+    // No allowed changes: SDL converts to the hardware format behind the callback
+    audio->device = SDL_OpenAudioDevice(NULL, 0, &want, NULL, 0);
+    if (audio->device == 0) {
+        std::cout << "Audio Device Error: " << SDL_GetError() << std::endl;
+        return false;
+    }
+    return true;
+}
+
+inline void audioStart(AudioEngine* audio) {
+    if (audio->device != 0) {
+        SDL_PauseAudioDevice(audio->device, 0);
+    }
+}
+
+// Adds a sample that is already mono float at AUDIO_FREQUENCY. Takes ownership
+// of data. Must be called before audioStart().
+inline int audioAddSample(AudioEngine* audio, float* data, int length) {
+    if (data == NULL || audio->numSamples >= AUDIO_MAX_SAMPLES) {
+        free(data);
+        return -1;
+    }
+    audio->samples[audio->numSamples].data = data;
+    audio->samples[audio->numSamples].length = length;
+    return audio->numSamples++;
+}
+
+// Decodes a WAV file into mono float at the mixer rate. Returns -1 if the
+// file is missing or cannot be converted.
+inline int audioLoadWav(AudioEngine* audio, const char* file) {
+    SDL_AudioSpec spec;
+    Uint8* buffer = NULL;
+    Uint32 length = 0;
+    if (SDL_LoadWAV(file, &spec, &buffer, &length) == NULL) {
+        return -1;
+    }
+
+    SDL_AudioCVT cvt;
+    if (SDL_BuildAudioCVT(&cvt, spec.format, spec.channels, spec.freq, AUDIO_F32SYS, 1, AUDIO_FREQUENCY) < 0) {
+        std::cout << "Audio Convert Error: " << SDL_GetError() << std::endl;
+        SDL_FreeWAV(buffer);
+        return -1;
+    }
+    cvt.len = length;
+    cvt.buf = (Uint8*)malloc(length * cvt.len_mult);
+    if (cvt.buf == NULL) {
+        SDL_FreeWAV(buffer);
+        return -1;
+    }
+    memcpy(cvt.buf, buffer, length);
+    SDL_FreeWAV(buffer);
+    if (!cvt.needed) {
+        cvt.len_cvt = length;
+    } else if (SDL_ConvertAudio(&cvt) != 0) {
+        free(cvt.buf);
+        return -1;
+    }
+    return audioAddSample(audio, (float*)cvt.buf, cvt.len_cvt / (int)sizeof(float));
+}
+
+// Builds a short decaying tone sweeping from startHz to endHz, mixed with
+// some noise. Used when no WAV file is shipped for an effect.
+inline int audioSynthesize(AudioEngine* audio, float seconds, float startHz, float endHz, float noise) {
+    int length = (int)(seconds * AUDIO_FREQUENCY);
+    float* data = (float*)malloc(length * sizeof(float));
+    if (data == NULL) {
+        return -1;
+    }
+
+    Uint32 seed = 0x12345678u;
+    double phase = 0.0;
+    for (int i = 0; i < length; ++i) {
+        float t = (float)i / length;
+        float frequency = startHz + (endHz - startHz) * t;
+        phase += 2.0 * M_PI * frequency / AUDIO_FREQUENCY;
+        seed = seed * 1664525u + 1013904223u;
+        float white = (float)(seed >> 8) / (float)(1 << 24) * 2.0f - 1.0f;
+        float envelope = (1.0f - t) * (1.0f - t);
+        data[i] = ((float)sin(phase) * (1.0f - noise) + white * noise) * envelope * 0.5f;
+    }
+    return audioAddSample(audio, data, length);
+}
+
+inline int audioLoadEffect(AudioEngine* audio, const char* file, float seconds, float startHz, float endHz, float noise) {
+    int sample = audioLoadWav(audio, file);
+    if (sample < 0) {
+        sample = audioSynthesize(audio, seconds, startHz, endHz, noise);
+    }
+    return sample;
+}
+
+inline bool audioPost(AudioEngine* audio, int type, int sample, float volume) {
+    if (audio->device == 0 || sample < 0) {
+        return false;
+    }
+    int tail = SDL_AtomicGet(&audio->tail);
+    if (tail - SDL_AtomicGet(&audio->head) >= AUDIO_QUEUE_SIZE) {
+        audio->droppedCommands++;
+        return false;
+    }
+    AudioCommand* command = &audio->queue[tail & (AUDIO_QUEUE_SIZE - 1)];
+    command->type = type;
+    command->sample = sample;
+    command->volume = volume;
+    SDL_AtomicSet(&audio->tail, tail + 1);  // full barrier: the command is visible first
+    return true;
+}
+
+inline bool audioPlay(AudioEngine* audio, int sample) {
+    return audioPost(audio, AUDIO_CMD_PLAY, sample, 1.0f);
+}
+
+inline bool audioStop(AudioEngine* audio, int sample) {
+    return audioPost(audio, AUDIO_CMD_STOP, sample, 0.0f);
+}
+
+// Call after audioClose(), once the callback can no longer run.
+inline void audioPrintStats(const AudioEngine* audio) {
+    if (audio->callbacks == 0) {
+        return;
+    }
+    std::cout << "Audio: " << audio->callbacks << " callbacks, avg "
+              << (double)audio->totalCallbackNs / audio->callbacks / 1000.0 << " us, max "
+              << audio->maxCallbackNs / 1000.0 << " us of "
+              << AUDIO_BUFFER_FRAMES * 1000000.0 / AUDIO_FREQUENCY << " us budget, "
+              << audio->droppedCommands << " dropped commands" << std::endl;
+}
+
+inline void audioClose(AudioEngine* audio) {
+    if (audio->device != 0) {
+        SDL_CloseAudioDevice(audio->device);
+        audio->device = 0;
+    }
+    for (int i = 0; i < audio->numSamples; ++i) {
+        free(audio->samples[i].data);
+        audio->samples[i].data = NULL;
+    }
+    audio->numSamples = 0;
+}
+
+#endif
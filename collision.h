@@ -0,0 +1,140 @@
+#ifndef COLLISION_H
+#define COLLISION_H
+
+// Pixel-accurate collision from sprite alpha.
+//
+// A mask is built once per sprite at the size it is drawn, one bit per pixel
+// that is mostly opaque, packed into 64-bit words. Word k of every row is
+// stored contiguously (bits[k * height + y], bit i is column 64 * k + i), so
+// the overlap test walks rows two at a time with SSE2: the other mask's words
+// are shifted into alignment and ANDed, and any set bit is a hit. Only call
+// it once the bounding boxes are known to overlap.
+
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_image.h>
+#include <iostream>
+#include <stdlib.h>
+#include <string.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#define COLLISION_ALPHA_THRESHOLD 128
+
+typedef struct {
+    int width;
+    int height;
+    int wordsPerRow;
+    Uint64* bits;
+} CollisionMask;
+
+// Builds a width x height mask from an image's alpha channel, scaling with
+// nearest-neighbour sampling the same way the sprite is stretched on screen.
+inline bool collisionMaskLoad(CollisionMask* mask, const char* file, int width, int height) {
+    memset(mask, 0, sizeof(*mask));
+    SDL_Surface* loaded = IMG_Load(file);
+    if (loaded == NULL) {
+        std::cout << "Collision Mask Load Error: " << IMG_GetError() << std::endl;
+        return false;
+    }
+    SDL_Surface* surface = SDL_ConvertSurfaceFormat(loaded, SDL_PIXELFORMAT_RGBA32, 0);
+    SDL_FreeSurface(loaded);
+    if (surface == NULL) {
+        std::cout << "Collision Mask Convert Error: " << SDL_GetError() << std::endl;
+        return false;
+    }
+
+    mask->width = width;
+    mask->height = height;
+    mask->wordsPerRow = (width + 63) / 64;
+    mask->bits = (Uint64*)calloc(mask->wordsPerRow * height, sizeof(Uint64));
+    if (mask->bits == NULL) {
+        SDL_FreeSurface(surface);
+        return false;
+    }
+
+    SDL_LockSurface(surface);
+    const Uint8* pixels = (const Uint8*)surface->pixels;
+    for (int y = 0; y < height; ++y) {
+        const Uint8* row = pixels + (y * surface->h / height) * surface->pitch;
+        for (int x = 0; x < width; ++x) {
+            Uint8 alpha = row[(x * surface->w / width) * 4 + 3];
+            if (alpha >= COLLISION_ALPHA_THRESHOLD) {
+                mask->bits[(x >> 6) * height + y] |= (Uint64)1 << (x & 63);
+            }
+        }
+    }
+    SDL_UnlockSurface(surface);
+    SDL_FreeSurface(surface);
+    return true;
+}
+
+inline void collisionMaskFree(CollisionMask* mask) {
+    free(mask->bits);
+    mask->bits = NULL;
+}
+
+// True if any opaque pixel of a, drawn at (ax, ay), covers an opaque pixel
+// of b drawn at (bx, by).
+inline bool collisionMaskOverlap(const CollisionMask* a, int ax, int ay, const CollisionMask* b, int bx, int by) {
+    // Rows of the overlap, in a's coordinates
+    int top = (by > ay ? by : ay) - ay;
+    int bottom = ((by + b->height < ay + a->height) ? by + b->height : ay + a->height) - ay;
+    int left = (bx > ax ? bx : ax) - ax;
+    int right = ((bx + b->width < ax + a->width) ? bx + b->width : ax + a->width) - ax;
+    if (top >= bottom || left >= right) {
+        return false;
+    }
+
+    int rowShift = ay - by;   // b row = a row + rowShift
+    int columnShift = ax - bx;  // b column = a column + columnShift
+
+    for (int k = left >> 6; k <= (right - 1) >> 6; ++k) {
+        // b bits for a's columns 64k .. 64k + 63 start at b column 'start'
+        int start = k * 64 + columnShift;
+        int word = start >> 6;           // arithmetic shift: floor for negatives
+        int shift = start & 63;
+        const Uint64* aColumn = a->bits + k * a->height;
+        const Uint64* loColumn = (word >= 0 && word < b->wordsPerRow) ? b->bits + word * b->height : NULL;
+        const Uint64* hiColumn = (shift != 0 && word + 1 >= 0 && word + 1 < b->wordsPerRow) ? b->bits + (word + 1) * b->height : NULL;
+        if (loColumn == NULL && hiColumn == NULL) {
+            continue;
+        }
+
+        int y = top;
+#ifdef __SSE2__
+        __m128i right64 = _mm_cvtsi32_si128(shift);
+        __m128i left64 = _mm_cvtsi32_si128(64 - shift);
+        __m128i zero = _mm_setzero_si128();
+        for (; y + 1 < bottom; y += 2) {
+            __m128i aBits = _mm_loadu_si128((const __m128i*)(aColumn + y));
+            __m128i bBits = zero;
+            if (loColumn != NULL) {
+                bBits = _mm_srl_epi64(_mm_loadu_si128((const __m128i*)(loColumn + y + rowShift)), right64);
+            }
+            if (hiColumn != NULL) {
+                bBits = _mm_or_si128(bBits, _mm_sll_epi64(_mm_loadu_si128((const __m128i*)(hiColumn + y + rowShift)), left64));
+            }
+            __m128i hit = _mm_cmpeq_epi32(_mm_and_si128(aBits, bBits), zero);
+            if (_mm_movemask_epi8(hit) != 0xFFFF) {
+                return true;
+            }
+        }
+#endif
+        for (; y < bottom; ++y) {
+            Uint64 bBits = 0;
+            if (loColumn != NULL) {
+                bBits = loColumn[y + rowShift] >> shift;
+            }
+            if (hiColumn != NULL) {
+                bBits |= hiColumn[y + rowShift] << (64 - shift);
+            }
+            if (aColumn[y] & bBits) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+#endif
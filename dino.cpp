@@ -3,7 +3,20 @@
 #include <SDL2/SDL_ttf.h>
 #include<iostream>
 #include <stdbool.h>
+#include <stdio.h>
 #include <stdlib.h> // For random module
+#include <string.h>
+#include <math.h>
+#include "jobs.h"
+#include "netplay.h"
+#include "spectator.h"
+#include "audio.h"
+#include "triplebuffer.h"
+#include "quality.h"
+#include "collision.h"
+#include "texture.h"
+#include "renderqueue.h"
+#include "flowfield.h"
 
 #define WINDOW_WIDTH 1000
 #define WINDOW_HEIGHT 700
@@ -13,40 +26,168 @@
 #define MOVE_SPEED 12
 #define MAX_JUMPS 4
 #define NUM_STONES 20
+#define MAX_PLAYERS 2
+#define SIM_STEPS_PER_SECOND 60
+#define TEXTURE_BUDGET_MB 64
+#define TEXTURE_BUDGET_MAX_MB 1024  // keeps the budget in bytes within an int
+#define OVERLAY_LINES 4
+#define HOMING_GHOST_SIZE 60
+#define HOMING_SPEED 3.0f        // pixels per step, well below MOVE_SPEED
+#define HOMING_STEERING 0.15f    // fraction of the way to the desired velocity per step
+#define HOMING_CELL_SIZE 20      // flow field cell size in pixels
+#define HOMING_GRAIN 2048        // homing ghosts updated per job
+#define HOMING_BENCH_GHOSTS 10000
+#define COLLISION_SAMPLE_SPACING 8  // max pixels of relative motion between mask tests
+
+// Render queue layers, drawn in this order
+#define LAYER_BACKGROUND 0
+#define LAYER_GROUND_DETAIL 1
+#define LAYER_SCENERY 2
+#define LAYER_ACTORS 3
+#define LAYER_GHOSTS 4
+
+// Simulation thread commands
+#define SIM_RUN 0
+#define SIM_PAUSED 1   // stopped on a hit until the game over menu is answered
+#define SIM_RESTART 2
+#define SIM_QUIT 3
+
+// Per-frame input bits, so a frame can be replayed from its inputs alone
+#define INPUT_JUMP 0x01
+#define INPUT_LEFT 0x02
+#define INPUT_RIGHT 0x04
+
+// Things that happened during a step, for sound effects
+#define EVENT_JUMP 0x01
+#define EVENT_LAND 0x02
+#define EVENT_HIT 0x04
 
 typedef struct {
     int x, y, size;
 } Stone;
 
 typedef struct {
-    SDL_Texture* texture;
+    TextureHandle texture;
     SDL_Rect rect;
     int velocity_y;
     int velocity_x;
     int jumpCount;
+    const CollisionMask* mask;  // NULL to collide on the bounding box alone
 } Dinosaur;
 
 typedef struct {
-    SDL_Texture* texture;
+    TextureHandle texture;
     SDL_Rect rect;
     double velocity_x;
     bool active;
+    const CollisionMask* mask;
 } Ghost;
 
-bool init(SDL_Window** window, SDL_Renderer** renderer) {
+// Everything the simulation reads and writes; copied whole for rollback snapshots
+typedef struct {
+    Dinosaur dinos[MAX_PLAYERS];
+    Ghost ghost;
+    int numPlayers;
+    int score;
+    int events;  // EVENT_* raised by the last step
+} GameState;
+
+typedef struct {
+    int jump;
+    int land;
+    int hit;
+} SoundEffects;
+
+typedef struct {
+    bool versus;
+    int localPlayer;
+    int localPort;
+    const char* remoteHost;
+    int remotePort;
+    int spectatePort;            // 0 when no TCP spectators are served
+    bool spectateRemote;         // accept TCP spectators from other machines, not just this one
+    const char* spectateSocket;  // NULL when no Unix socket spectators are served
+    int windowWidth;
+    int windowHeight;
+    bool fullscreen;             // borderless at the desktop's native resolution
+    float renderScale;           // internal resolution relative to the on-screen size
+    double frameBudgetMs;
+    int textureBudgetMb;
+    int workers;                 // job system threads
+    bool benchCollision;         // time the collision narrowphase and exit
+    bool benchJobs;              // time the job system on 1 to 16 threads and exit
+    int homingGhosts;            // ghosts that chase the dino, single player only
+    bool benchHoming;            // time homing ghost updates and exit
+    int benchSpectators;         // subscribers to time spectator publishing with, 0 for none
+} Options;
+
+// Everything the render thread draws for one frame; never changed once published
+typedef struct {
+    Dinosaur dinos[MAX_PLAYERS];
+    int numPlayers;
+    Ghost ghost;
+    int score;
+    bool hit;
+    NetplayStats netStats;
+    SDL_Rect* homing;             // HomingSwarm.count rects, allocated per slot
+    int numHoming;
+} RenderSnapshot;
+
+typedef struct {
+    float x;
+    float y;
+    float velocity_x;
+    float velocity_y;
+} HomingGhost;
+
+// Ghosts that chase the first dino by following a flow field. Owned by the
+// simulation thread; single player only, since they are not part of the
+// rollback state.
+typedef struct {
+    HomingGhost* ghosts;
+    int count;
+    FlowField field;
+    const CollisionMask* mask;    // NULL to collide on the bounding box alone
+    SDL_atomic_t hits;            // ghosts touching the dino in the last step
+} HomingSwarm;
+
+// Shared between the render thread (events, drawing, menus) and the
+// simulation thread, which owns the GameState and everything it feeds.
+typedef struct {
+    GameState* game;
+    NetplaySession* session;      // NULL outside versus mode
+    SpectatorServer* spectators;  // NULL when nobody can watch
+    HomingSwarm* homing;          // NULL without homing ghosts
+    JobSystem* jobs;              // splits the homing ghost updates
+    AudioEngine* audio;
+    const SoundEffects* sounds;
+    SDL_atomic_t held;            // INPUT_LEFT / INPUT_RIGHT currently held
+    SDL_atomic_t jumps;           // jump presses not yet simulated
+    SDL_atomic_t command;         // SIM_*
+    RenderSnapshot snapshots[3];
+    TripleBuffer handoff;
+} Simulation;
+
+bool init(SDL_Window** window, SDL_Renderer** renderer, JobSystem* jobs, const Options* options) {
+    // Audio is optional and started separately in main()
     if (SDL_Init(SDL_INIT_VIDEO) != 0) {
         std::cout<<"SDL Init Error: "<<TTF_GetError()<<std::endl;
         return false;
     }
 
-    *window = SDL_CreateWindow("Jumping Dino", SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, WINDOW_WIDTH, WINDOW_HEIGHT, 0);
+    Uint32 windowFlags = SDL_WINDOW_RESIZABLE | SDL_WINDOW_ALLOW_HIGHDPI;
+    if (options->fullscreen) {
+        windowFlags |= SDL_WINDOW_FULLSCREEN_DESKTOP;
+    }
+    *window = SDL_CreateWindow("Jumping Dino", SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, options->windowWidth, options->windowHeight, windowFlags);
     if (*window == NULL) {
         std::cout<<"Window Error: "<<TTF_GetError()<<std::endl;
         SDL_Quit();
         return false;
     }
 
-    *renderer = SDL_CreateRenderer(*window, -1, SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC);
+    SDL_SetHint(SDL_HINT_RENDER_SCALE_QUALITY, "1");
+    *renderer = SDL_CreateRenderer(*window, -1, SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC | SDL_RENDERER_TARGETTEXTURE);
     if (*renderer == NULL) {
         SDL_DestroyWindow(*window);
         std::cout<<"Renderer Error: "<<TTF_GetError()<<std::endl;
@@ -54,7 +195,12 @@ bool init(SDL_Window** window, SDL_Renderer** renderer) {
         return false;
     }
 
-    int imgFlags = IMG_INIT_PNG;
+    // Everything is drawn in WINDOW_WIDTH x WINDOW_HEIGHT coordinates whatever the window size
+    SDL_RenderSetLogicalSize(*renderer, WINDOW_WIDTH, WINDOW_HEIGHT);
+
+    // Every format the game loads, up front: the loaders would otherwise
+    // initialize themselves, which is not safe while images decode in parallel
+    int imgFlags = IMG_INIT_PNG | IMG_INIT_JPG;
     if (!(IMG_Init(imgFlags) & imgFlags)) {
         std::cout<<"Image Init Error: "<<TTF_GetError()<<std::endl;
         SDL_DestroyRenderer(*renderer);
@@ -72,18 +218,21 @@ bool init(SDL_Window** window, SDL_Renderer** renderer) {
         return false;
     }
 
+    if (!jobSystemInit(jobs, options->workers)) {
+        SDL_DestroyRenderer(*renderer);
+        SDL_DestroyWindow(*window);
+        TTF_Quit();
+        IMG_Quit();
+        SDL_Quit();
+        return false;
+    }
+
     return true;
 }
 
-SDL_Texture* loadTexture(const char* file, SDL_Renderer* renderer) {
-    SDL_Texture* texture = IMG_LoadTexture(renderer, file);
-    if (texture == NULL) {
-        std::cout<<"Image Load Texture Error: "<<TTF_GetError()<<std::endl;
-    }
-    return texture;
-}
+void handleEvents(bool* running, Uint8* input, bool* showOverlay) {
+    *input &= ~INPUT_JUMP;
 
-void handleEvents(bool* running, Dinosaur* dino) {
     SDL_Event event;
     while (SDL_PollEvent(&event)) {
         if (event.type == SDL_QUIT) {
@@ -92,16 +241,16 @@ void handleEvents(bool* running, Dinosaur* dino) {
         if (event.type == SDL_KEYDOWN) {
             switch (event.key.keysym.sym) {
                 case SDLK_UP:
-                    if (dino->jumpCount < MAX_JUMPS) {
-                        dino->velocity_y = -JUMP_STRENGTH;
-                        dino->jumpCount++;
-                    }
+                    *input |= INPUT_JUMP;
                     break;
                 case SDLK_LEFT:
-                    dino->velocity_x = -MOVE_SPEED;
+                    *input = (*input & ~INPUT_RIGHT) | INPUT_LEFT;
                     break;
                 case SDLK_RIGHT:
-                    dino->velocity_x = MOVE_SPEED;
+                    *input = (*input & ~INPUT_LEFT) | INPUT_RIGHT;
+                    break;
+                case SDLK_F3:
+                    *showOverlay = !*showOverlay;
                     break;
             }
         }
@@ -109,23 +258,47 @@ void handleEvents(bool* running, Dinosaur* dino) {
             switch (event.key.keysym.sym) {
                 case SDLK_LEFT:
                 case SDLK_RIGHT:
-                    dino->velocity_x = 0;
+                    *input &= ~(INPUT_LEFT | INPUT_RIGHT);
                     break;
             }
         }
     }
 }
 
-void updateDino(Dinosaur* dino) {
+// Returns true if the dino jumped.
+bool applyInput(Dinosaur* dino, Uint8 input) {
+    bool jumped = false;
+    if ((input & INPUT_JUMP) && dino->jumpCount < MAX_JUMPS) {
+        dino->velocity_y = -JUMP_STRENGTH;
+        dino->jumpCount++;
+        jumped = true;
+    }
+
+    if (input & INPUT_LEFT) {
+        dino->velocity_x = -MOVE_SPEED;
+    } else if (input & INPUT_RIGHT) {
+        dino->velocity_x = MOVE_SPEED;
+    } else {
+        dino->velocity_x = 0;
+    }
+    return jumped;
+}
+
+// Returns true if the dino touched down this step.
+bool updateDino(Dinosaur* dino) {
+    int groundLevel = WINDOW_HEIGHT - GROUND_HEIGHT - dino->rect.h;
+    bool airborne = dino->rect.y < groundLevel;
+
     dino->rect.y += dino->velocity_y;
     dino->rect.x += dino->velocity_x;
 
     dino->velocity_y += GRAVITY;
 
-    int groundLevel = WINDOW_HEIGHT - GROUND_HEIGHT - dino->rect.h;
+    bool landed = false;
 
     // Prevent the dino from going below the ground
     if (dino->rect.y >= groundLevel) {
+        landed = airborne;
         dino->rect.y = groundLevel;
         dino->velocity_y = 0;
         dino->jumpCount = 0;
@@ -143,6 +316,111 @@ void updateDino(Dinosaur* dino) {
     } else if (dino->rect.x > WINDOW_WIDTH - dino->rect.w) {
         dino->rect.x = WINDOW_WIDTH - dino->rect.w;
     }
+
+    return landed;
+}
+
+// Discrete AABB overlap test. Touching edges do not count.
+bool checkCollision(const SDL_Rect* a, const SDL_Rect* b) {
+    return (a->x + a->w > b->x &&
+            a->x < b->x + b->w &&
+            a->y + a->h > b->y &&
+            a->y < b->y + b->h);
+}
+
+// Swept AABB test. Box a moves from prevA to a while box b moves from prevB
+// to b, both in a straight line over the step. Returns the time of impact in
+// [0, 1) as a fraction of the step, or -1 if the boxes never overlap. Touching
+// edges do not count, matching checkCollision. If exitTime is not NULL it gets
+// the time the boxes separate again, which may be past the end of the step.
+float sweptCollision(const SDL_Rect* prevA, const SDL_Rect* a, const SDL_Rect* prevB, const SDL_Rect* b, float* exitTime) {
+    // Work in b's frame of reference, where b stays at prevB
+    float dx = (float)((a->x - prevA->x) - (b->x - prevB->x));
+    float dy = (float)((a->y - prevA->y) - (b->y - prevB->y));
+
+    float entryX, exitX;
+    if (dx == 0.0f) {
+        if (prevA->x + prevA->w <= prevB->x || prevA->x >= prevB->x + prevB->w) {
+            return -1.0f;
+        }
+        entryX = -1.0f;
+        exitX = 2.0f;
+    } else if (dx > 0.0f) {
+        entryX = (prevB->x - (prevA->x + prevA->w)) / dx;
+        exitX = (prevB->x + prevB->w - prevA->x) / dx;
+    } else {
+        entryX = (prevB->x + prevB->w - prevA->x) / dx;
+        exitX = (prevB->x - (prevA->x + prevA->w)) / dx;
+    }
+
+    float entryY, exitY;
+    if (dy == 0.0f) {
+        if (prevA->y + prevA->h <= prevB->y || prevA->y >= prevB->y + prevB->h) {
+            return -1.0f;
+        }
+        entryY = -1.0f;
+        exitY = 2.0f;
+    } else if (dy > 0.0f) {
+        entryY = (prevB->y - (prevA->y + prevA->h)) / dy;
+        exitY = (prevB->y + prevB->h - prevA->y) / dy;
+    } else {
+        entryY = (prevB->y + prevB->h - prevA->y) / dy;
+        exitY = (prevB->y - (prevA->y + prevA->h)) / dy;
+    }
+
+    float entry = entryX > entryY ? entryX : entryY;
+    float exit = exitX < exitY ? exitX : exitY;
+    if (entry >= exit || entry >= 1.0f || exit <= 0.0f) {
+        return -1.0f;
+    }
+    if (exitTime != NULL) {
+        *exitTime = exit;
+    }
+    return entry > 0.0f ? entry : 0.0f;
+}
+
+// Broadphase with the swept boxes, then the sprite masks at points along the
+// part of the step where the boxes overlap, at most COLLISION_SAMPLE_SPACING
+// pixels of relative motion apart. Opaque features thinner than that, such
+// as a ghost's tail or a dino's leg, can still pass through each other
+// between two samples. Sprites without a mask collide on their boxes alone.
+bool spritesHit(const SDL_Rect* prevA, const SDL_Rect* a, const CollisionMask* maskA,
+                const SDL_Rect* prevB, const SDL_Rect* b, const CollisionMask* maskB) {
+    // Most pairs are far apart: reject them on the boxes covering each path
+    SDL_Rect pathA, pathB;
+    SDL_UnionRect(prevA, a, &pathA);
+    SDL_UnionRect(prevB, b, &pathB);
+    if (!checkCollision(&pathA, &pathB)) {
+        return false;
+    }
+
+    float exit;
+    float entry = sweptCollision(prevA, a, prevB, b, &exit);
+    if (entry < 0.0f) {
+        return false;
+    }
+    if (maskA == NULL || maskB == NULL) {
+        return true;
+    }
+    if (exit > 1.0f) {
+        exit = 1.0f;
+    }
+
+    int dx = abs((a->x - prevA->x) - (b->x - prevB->x));
+    int dy = abs((a->y - prevA->y) - (b->y - prevB->y));
+    float travel = (dx > dy ? dx : dy) * (exit - entry);
+    int samples = 1 + (int)(travel / COLLISION_SAMPLE_SPACING);
+    for (int s = 0; s <= samples; ++s) {
+        float t = entry + (exit - entry) * s / samples;
+        int aX = prevA->x + (int)lroundf((a->x - prevA->x) * t);
+        int aY = prevA->y + (int)lroundf((a->y - prevA->y) * t);
+        int bX = prevB->x + (int)lroundf((b->x - prevB->x) * t);
+        int bY = prevB->y + (int)lroundf((b->y - prevB->y) * t);
+        if (collisionMaskOverlap(maskA, aX, aY, maskB, bX, bY)) {
+            return true;
+        }
+    }
+    return false;
 }
 
 void updateGhost(Ghost* ghost) {
@@ -152,95 +430,340 @@ void updateGhost(Ghost* ghost) {
     }
 }
 
-bool checkCollision(SDL_Rect* a, SDL_Rect* b) {
-    return (a->x + a->w > b->x &&
-            a->x < b->x + b->w &&
-            a->y + a->h > b->y &&
-            a->y < b->y + b->h);
+// Hash of (seed, index, salt): a repeatable random value per object that
+// does not depend on the order the objects are visited in.
+Uint32 hashRandom(Uint32 seed, int index, int salt) {
+    Uint32 x = seed ^ ((Uint32)index * 0x9E3779B9u) ^ ((Uint32)salt * 0x85EBCA6Bu);
+    x ^= x >> 16;
+    x *= 0x7FEB352Du;
+    x ^= x >> 15;
+    x *= 0x846CA68Bu;
+    x ^= x >> 16;
+    return x;
+}
+
+typedef struct {
+    Stone* stones;
+    Uint32 seed;
+} StoneBatch;
+
+// Scatters stones over the soil. Each stone depends only on the seed and its
+// index, so the ground comes out the same on whichever thread builds it.
+void generateStonesJob(void* data, int begin, int end) {
+    StoneBatch* batch = (StoneBatch*)data;
+    for (int i = begin; i < end; ++i) {
+        Stone* stone = &batch->stones[i];
+        stone->x = hashRandom(batch->seed, i, 0) % WINDOW_WIDTH;
+        stone->y = hashRandom(batch->seed, i, 1) % (GROUND_HEIGHT / 2) + (WINDOW_HEIGHT - GROUND_HEIGHT / 2);
+        stone->size = hashRandom(batch->seed, i, 2) % 10 + 5;
+    }
+}
+
+bool homingInit(HomingSwarm* swarm, int count, const CollisionMask* mask) {
+    memset(swarm, 0, sizeof(*swarm));
+    swarm->ghosts = (HomingGhost*)calloc(count, sizeof(HomingGhost));
+    if (swarm->ghosts == NULL || !flowFieldInit(&swarm->field, WINDOW_WIDTH, WINDOW_HEIGHT, HOMING_CELL_SIZE)) {
+        std::cout << "Homing Ghost Error: out of memory" << std::endl;
+        free(swarm->ghosts);
+        return false;
+    }
+    swarm->count = count;
+    swarm->mask = mask;
+
+    // Ghosts fly; the ground is solid
+    SDL_Rect ground = {0, WINDOW_HEIGHT - GROUND_HEIGHT, WINDOW_WIDTH, GROUND_HEIGHT};
+    flowFieldBlock(&swarm->field, &ground);
+    return true;
+}
+
+void homingFree(HomingSwarm* swarm) {
+    free(swarm->ghosts);
+    swarm->ghosts = NULL;
+    flowFieldFree(&swarm->field);
 }
 
-void renderGrassAndSoil(SDL_Renderer* renderer, SDL_Rect* groundRect, Stone* stones, int numStones) {
+// Scatters the ghosts along the left and right edges of the sky.
+void resetHoming(HomingSwarm* swarm, Uint32 seed) {
+    int skyHeight = WINDOW_HEIGHT - GROUND_HEIGHT - HOMING_GHOST_SIZE;
+    for (int i = 0; i < swarm->count; ++i) {
+        HomingGhost* ghost = &swarm->ghosts[i];
+        ghost->x = (i & 1) ? (float)(WINDOW_WIDTH - HOMING_GHOST_SIZE) : 0.0f;
+        ghost->y = (float)(hashRandom(seed, i, 0) % skyHeight);
+        ghost->velocity_x = 0.0f;
+        ghost->velocity_y = 0.0f;
+    }
+}
+
+typedef struct {
+    HomingSwarm* swarm;
+    float targetX;             // centre of the dino being chased
+    float targetY;
+    const Dinosaur* dino;
+    const SDL_Rect* prevDino;  // the dino's rect at the start of the step
+} HomingStep;
+
+void updateHomingJob(void* data, int begin, int end) {
+    HomingStep* step = (HomingStep*)data;
+    HomingSwarm* swarm = step->swarm;
+    const float half = HOMING_GHOST_SIZE / 2.0f;
+    const float maxY = (float)(WINDOW_HEIGHT - GROUND_HEIGHT - HOMING_GHOST_SIZE);
+    int hits = 0;
+    for (int i = begin; i < end; ++i) {
+        HomingGhost* ghost = &swarm->ghosts[i];
+        SDL_Rect prevRect = {(int)ghost->x, (int)ghost->y, HOMING_GHOST_SIZE, HOMING_GHOST_SIZE};
+        float centerX = ghost->x + half;
+        float centerY = ghost->y + half;
+
+        float dx, dy;
+        if (!flowFieldSteer(&swarm->field, centerX, centerY, &dx, &dy)) {
+            // In the dino's cell: head straight for it
+            dx = step->targetX - centerX;
+            dy = step->targetY - centerY;
+            float length = sqrtf(dx * dx + dy * dy);
+            if (length > 0.001f) {
+                dx /= length;
+                dy /= length;
+            }
+        }
+        ghost->velocity_x += (dx * HOMING_SPEED - ghost->velocity_x) * HOMING_STEERING;
+        ghost->velocity_y += (dy * HOMING_SPEED - ghost->velocity_y) * HOMING_STEERING;
+        ghost->x += ghost->velocity_x;
+        ghost->y += ghost->velocity_y;
+
+        if (ghost->x < 0.0f) ghost->x = 0.0f;
+        if (ghost->x > WINDOW_WIDTH - HOMING_GHOST_SIZE) ghost->x = (float)(WINDOW_WIDTH - HOMING_GHOST_SIZE);
+        if (ghost->y < 0.0f) ghost->y = 0.0f;
+        if (ghost->y > maxY) ghost->y = maxY;
+
+        // Swept like the big ghost: a dashing dino covers its own width in a few steps
+        SDL_Rect rect = {(int)ghost->x, (int)ghost->y, HOMING_GHOST_SIZE, HOMING_GHOST_SIZE};
+        if (spritesHit(step->prevDino, &step->dino->rect, step->dino->mask, &prevRect, &rect, swarm->mask)) {
+            hits++;
+        }
+    }
+    if (hits > 0) {
+        SDL_AtomicAdd(&swarm->hits, hits);
+    }
+}
+
+// Rebuilds the flow field if the dino changed cells, then moves every ghost
+// by one lookup into it. Returns true if any ghost touched the dino on its
+// way from prevDino to where it is now.
+bool updateHoming(JobSystem* jobs, HomingSwarm* swarm, const Dinosaur* dino, const SDL_Rect* prevDino) {
+    HomingStep step = {swarm, dino->rect.x + dino->rect.w / 2.0f, dino->rect.y + dino->rect.h / 2.0f, dino, prevDino};
+    flowFieldUpdate(&swarm->field, step.targetX, step.targetY);
+
+    SDL_AtomicSet(&swarm->hits, 0);
+    JobCounter updated = {};
+    jobParallelFor(jobs, updateHomingJob, &step, swarm->count, HOMING_GRAIN, &updated);
+    jobWait(jobs, &updated);
+    return SDL_AtomicGet(&swarm->hits) > 0;
+}
+
+bool dinoHitsGhost(const Dinosaur* dino, const SDL_Rect* prevDino, const Ghost* ghost, const SDL_Rect* prevGhost) {
+    return spritesHit(prevDino, &dino->rect, dino->mask, prevGhost, &ghost->rect, ghost->mask);
+}
+
+void resetRound(GameState* game) {
+    for (int i = 0; i < game->numPlayers; ++i) {
+        game->dinos[i].rect.x = 320 + 200 * i;
+        game->dinos[i].rect.y = WINDOW_HEIGHT - GROUND_HEIGHT - game->dinos[i].rect.h;
+    }
+    game->ghost.rect.x = 0;
+    game->score = 0;
+}
+
+// Advances the game by one frame. Returns true if any dino hit the ghost.
+bool simulateStep(GameState* game, const Uint8* inputs) {
+    game->events = 0;
+
+    // Start-of-step positions, so fast movers are tested along their whole path
+    SDL_Rect prevDinos[MAX_PLAYERS];
+    for (int i = 0; i < game->numPlayers; ++i) {
+        prevDinos[i] = game->dinos[i].rect;
+    }
+
+    for (int i = 0; i < game->numPlayers; ++i) {
+        if (applyInput(&game->dinos[i], inputs[i])) {
+            game->events |= EVENT_JUMP;
+        }
+        if (updateDino(&game->dinos[i])) {
+            game->events |= EVENT_LAND;
+        }
+    }
+
+    Ghost* ghost = &game->ghost;
+    if (!ghost->active) {
+        ghost->rect.x = 0;
+        ghost->rect.y = WINDOW_HEIGHT - GROUND_HEIGHT - 80;
+        ghost->active = true;
+        ghost->velocity_x += 1;  // Increase the speed of the ghost
+    }
+    SDL_Rect prevGhost = ghost->rect;
+    updateGhost(ghost);
+
+    for (int i = 0; i < game->numPlayers; ++i) {
+        if (dinoHitsGhost(&game->dinos[i], &prevDinos[i], ghost, &prevGhost)) {
+            game->events |= EVENT_HIT;
+            return true;
+        }
+    }
+    return false;
+}
+
+void playEventSounds(AudioEngine* audio, const SoundEffects* sounds, int events) {
+    if (events & EVENT_JUMP) {
+        audioPlay(audio, sounds->jump);
+    }
+    if (events & EVENT_LAND) {
+        audioPlay(audio, sounds->land);
+    }
+    if (events & EVENT_HIT) {
+        audioPlay(audio, sounds->hit);
+    }
+}
+
+// Netplay advance callback: a versus round restarts on the spot instead of
+// opening the game over menu, so both peers stay in lockstep.
+int advanceVersusFrame(void* state, const Uint8* inputs) {
+    GameState* game = (GameState*)state;
+    if (simulateStep(game, inputs)) {
+        resetRound(game);
+    }
+    return game->events;
+}
+
+void renderGrassAndSoil(RenderQueue* queue, SDL_Rect* groundRect, Stone* stones, int numStones, int grassSpacing) {
     // Draw the soil
-    SDL_SetRenderDrawColor(renderer, 139, 69, 19, 255); // Brown color for soil
+    SDL_Color soilColor = {139, 69, 19, 255}; // Brown color for soil
     SDL_Rect soilRect = {groundRect->x, groundRect->y + (groundRect->h / 2), groundRect->w, groundRect->h / 2};
-    SDL_RenderFillRect(renderer, &soilRect);
+    renderQueueRect(queue, LAYER_BACKGROUND, 0, &soilRect, soilColor);
 
     // Draw the grass
-    SDL_SetRenderDrawColor(renderer, 34, 139, 34, 255); // Green color for grass
+    SDL_Color grassColor = {34, 139, 34, 255}; // Green color for grass
     SDL_Rect grassRect = {groundRect->x, groundRect->y, groundRect->w, groundRect->h / 2};
-    SDL_RenderFillRect(renderer, &grassRect);
+    renderQueueRect(queue, LAYER_BACKGROUND, 0, &grassRect, grassColor);
 
     // Add grass blades
-    SDL_SetRenderDrawColor(renderer, 0, 128, 0, 255); // Darker green for grass blades
-    for (int i = groundRect->x; i < groundRect->w; i += 10) {
+    SDL_Color bladeColor = {0, 128, 0, 255}; // Darker green for grass blades
+    for (int i = groundRect->x; i < groundRect->w; i += grassSpacing) {
         int bladeHeight = rand() % 10 + 5; // Random height for grass blades
-        SDL_RenderDrawLine(renderer, i, groundRect->y + (groundRect->h / 2) - bladeHeight, i, groundRect->y + (groundRect->h / 2));
+        SDL_Rect bladeRect = {i, groundRect->y + (groundRect->h / 2) - bladeHeight, 1, bladeHeight};
+        renderQueueRect(queue, LAYER_GROUND_DETAIL, 0, &bladeRect, bladeColor);
     }
 
     // Add stones/rocks
-    SDL_SetRenderDrawColor(renderer, 105, 105, 105, 255); // Dark gray color for stones
+    SDL_Color stoneColor = {105, 105, 105, 255}; // Dark gray color for stones
     for (int i = 0; i < numStones; ++i) {
         SDL_Rect stoneRect = {stones[i].x, stones[i].y, stones[i].size, stones[i].size};
-        SDL_RenderFillRect(renderer, &stoneRect);
+        renderQueueRect(queue, LAYER_GROUND_DETAIL, 1, &stoneRect, stoneColor);
     }
 }
 
-void renderBackground(SDL_Renderer* renderer, SDL_Texture* treeTexture, SDL_Texture* cloudTexture, Stone* stones, int numStones) {
+void renderBackground(RenderQueue* queue, TextureCache* textures, TextureHandle treeTexture, TextureHandle cloudTexture, Stone* stones, int numStones, const QualityLevel* quality) {
     // Sky
-    SDL_SetRenderDrawColor(renderer, 135, 206, 235, 255); // Sky blue
+    SDL_Color skyColor = {135, 206, 235, 255}; // Sky blue
     SDL_Rect skyRect = {0, 0, WINDOW_WIDTH, WINDOW_HEIGHT - GROUND_HEIGHT};
-    SDL_RenderFillRect(renderer, &skyRect);
+    renderQueueRect(queue, LAYER_BACKGROUND, 0, &skyRect, skyColor);
 
     // Ground
     SDL_Rect groundRect = {0, WINDOW_HEIGHT - GROUND_HEIGHT, WINDOW_WIDTH, GROUND_HEIGHT};
-    renderGrassAndSoil(renderer, &groundRect, stones, numStones);
+    if (numStones > quality->numStones) {
+        numStones = quality->numStones;
+    }
+    renderGrassAndSoil(queue, &groundRect, stones, numStones, quality->grassSpacing);
 
-    // Render trees
+    // Render trees, back to front
+    SDL_Color white = {255, 255, 255, 255};
+    SDL_Texture* tree = textureGet(textures, treeTexture);
     SDL_Rect treeRect1 = {90, WINDOW_HEIGHT - GROUND_HEIGHT - 160, 180, 180};
-    SDL_RenderCopy(renderer, treeTexture, NULL, &treeRect1);
+    renderQueueSprite(queue, LAYER_SCENERY, 0, tree, &treeRect1, white);
 
     SDL_Rect treeRect2 = {750, WINDOW_HEIGHT - GROUND_HEIGHT - 190, 250, 250};
-    SDL_RenderCopy(renderer, treeTexture, NULL, &treeRect2);
+    renderQueueSprite(queue, LAYER_SCENERY, 1, tree, &treeRect2, white);
 
     SDL_Rect treeRect3 = {250, WINDOW_HEIGHT - GROUND_HEIGHT - 130, 180, 180};
-    SDL_RenderCopy(renderer, treeTexture, NULL, &treeRect3);
+    renderQueueSprite(queue, LAYER_SCENERY, 2, tree, &treeRect3, white);
 
     // Render clouds
-    SDL_Rect cloudRect1 = {200, 50, 150, 100};
-    SDL_RenderCopy(renderer, cloudTexture, NULL, &cloudRect1);
-
-    SDL_Rect cloudRect2 = {400, 100, 150, 100};
-    SDL_RenderCopy(renderer, cloudTexture, NULL, &cloudRect2);
-
-    SDL_Rect cloudRect3 = {700, 50, 130, 100};
-    SDL_RenderCopy(renderer, cloudTexture, NULL, &cloudRect3);
+    SDL_Rect cloudRects[3] = {{200, 50, 150, 100}, {700, 50, 130, 100}, {400, 100, 150, 100}};
+    SDL_Texture* cloud = textureGet(textures, cloudTexture);
+    for (int i = 0; i < quality->numClouds && i < 3; ++i) {
+        renderQueueSprite(queue, LAYER_SCENERY, i, cloud, &cloudRects[i], white);
+    }
 }
 
-void render(SDL_Renderer* renderer, Dinosaur* dino, Ghost* ghost, SDL_Texture* treeTexture, SDL_Texture* cloudTexture, Stone* stones, int numStones) {
+// Draws the game scene; the caller presents it.
+void render(SDL_Renderer* renderer, RenderQueue* queue, TextureCache* textures, Dinosaur* dinos, int numDinos, Ghost* ghost, const SDL_Rect* homing, int numHoming, TextureHandle treeTexture, TextureHandle cloudTexture, Stone* stones, int numStones, const QualityLevel* quality) {
     SDL_SetRenderDrawColor(renderer, 255, 255, 255, 255);
     SDL_RenderClear(renderer);
 
-    renderBackground(renderer, treeTexture, cloudTexture, stones, numStones);
+    renderBackground(queue, textures, treeTexture, cloudTexture, stones, numStones, quality);
 
-    SDL_RenderCopy(renderer, dino->texture, NULL, &dino->rect);
-    SDL_RenderCopy(renderer, ghost->texture, NULL, &ghost->rect);
+    SDL_Texture* dinoTexture = textureGet(textures, dinos[0].texture);
+    for (int i = 0; i < numDinos; ++i) {
+        // Tint the second player so the two dinos can be told apart
+        SDL_Color tint = {255, 255, 255, 255};
+        if (i > 0) {
+            tint.g = 160;
+            tint.b = 160;
+        }
+        renderQueueSprite(queue, LAYER_ACTORS, i, dinoTexture, &dinos[i].rect, tint);
+    }
+    SDL_Color white = {255, 255, 255, 255};
+    SDL_Texture* ghostTexture = textureGet(textures, ghost->texture);
+    renderQueueSprite(queue, LAYER_GHOSTS, 0, ghostTexture, &ghost->rect, white);
+
+    // Homing ghosts share the ghost texture, so they all go in the same batch
+    SDL_Color homingTint = {200, 200, 255, 220};
+    for (int i = 0; i < numHoming; ++i) {
+        renderQueueSprite(queue, LAYER_GHOSTS, 1, ghostTexture, &homing[i], homingTint);
+    }
+
+    renderQueueFlush(queue, renderer);
+}
 
-    SDL_RenderPresent(renderer);
+// Draws lines of debug text in the top left corner, shown with F3.
+void renderOverlay(SDL_Renderer* renderer, TTF_Font* font, char lines[][256], int numLines) {
+    if (font == NULL) {
+        return;
+    }
+
+    SDL_Color textColor = {255, 255, 255, 255};
+    int y = 10;
+    for (int i = 0; i < numLines; ++i) {
+        SDL_Surface* surface = TTF_RenderText_Blended(font, lines[i], textColor);
+        if (surface == NULL) {
+            continue;
+        }
+        SDL_Texture* texture = SDL_CreateTextureFromSurface(renderer, surface);
+        // Half size keeps the longer lines on screen
+        SDL_Rect rect = {10, y, surface->w / 2, surface->h / 2};
+        SDL_SetRenderDrawBlendMode(renderer, SDL_BLENDMODE_BLEND);
+        SDL_SetRenderDrawColor(renderer, 0, 0, 0, 160);
+        SDL_RenderFillRect(renderer, &rect);
+        SDL_SetRenderDrawBlendMode(renderer, SDL_BLENDMODE_NONE);
+        SDL_RenderCopy(renderer, texture, NULL, &rect);
+        y += rect.h;
+        SDL_DestroyTexture(texture);
+        SDL_FreeSurface(surface);
+    }
 }
 
-void cleanUp(SDL_Window* window, SDL_Renderer* renderer, Dinosaur* dino, Ghost* ghost, SDL_Texture* treeTexture, SDL_Texture* cloudTexture, SDL_Texture* menuTexture) {
-    SDL_DestroyTexture(dino->texture);
-    SDL_DestroyTexture(ghost->texture);
-    SDL_DestroyTexture(treeTexture);
-    SDL_DestroyTexture(cloudTexture);
-    SDL_DestroyTexture(menuTexture);
+void cleanUp(SDL_Window* window, SDL_Renderer* renderer, JobSystem* jobs, TextureCache* textures, TTF_Font* font) {
+    if (font != NULL) {
+        TTF_CloseFont(font);
+    }
+    jobSystemDestroy(jobs);
+    textureCacheDestroy(textures);
     SDL_DestroyRenderer(renderer);
     SDL_DestroyWindow(window);
+    TTF_Quit();
     IMG_Quit();
     SDL_Quit();
 }
 
-bool mainMenu(SDL_Renderer* renderer, SDL_Texture* menuTexture) {
+bool mainMenu(SDL_Renderer* renderer, TextureCache* textures, TextureHandle menuTexture) {
     TTF_Font* font = TTF_OpenFont("arial.ttf", 24);
     if (!font) {
         std::cout << "Failed to load font: " << TTF_GetError() << std::endl;
@@ -281,8 +804,9 @@ bool mainMenu(SDL_Renderer* renderer, SDL_Texture* menuTexture) {
                 return false;
             }
             if (event.type == SDL_MOUSEBUTTONDOWN) {
-                int x, y;
-                SDL_GetMouseState(&x, &y);
+                // Button events are already in logical coordinates
+                int x = event.button.x;
+                int y = event.button.y;
                 if (x >= startButton.x && x <= startButton.x + startButton.w &&
                     y >= startButton.y && y <= startButton.y + startButton.h) {
                     running = false;
@@ -297,7 +821,7 @@ bool mainMenu(SDL_Renderer* renderer, SDL_Texture* menuTexture) {
         }
 
         SDL_RenderClear(renderer);
-        SDL_RenderCopy(renderer, menuTexture, NULL, NULL);
+        SDL_RenderCopy(renderer, textureGet(textures, menuTexture), NULL, NULL);
 
         SDL_RenderCopy(renderer, startTexture, NULL, &startButton);
         SDL_RenderCopy(renderer, exitTexture, NULL, &exitButton);
@@ -312,7 +836,7 @@ bool mainMenu(SDL_Renderer* renderer, SDL_Texture* menuTexture) {
     return false;
 }
 
-bool gameOverMenu(SDL_Renderer* renderer, SDL_Texture* menuTexture) {
+bool gameOverMenu(SDL_Renderer* renderer, TextureCache* textures, TextureHandle menuTexture) {
     TTF_Font* font = TTF_OpenFont("arial.ttf", 24);
     if (!font) {
         std::cout << "Failed to load font: " << TTF_GetError() << std::endl;
@@ -353,8 +877,9 @@ bool gameOverMenu(SDL_Renderer* renderer, SDL_Texture* menuTexture) {
                 return false;
             }
             if (event.type == SDL_MOUSEBUTTONDOWN) {
-                int x, y;
-                SDL_GetMouseState(&x, &y);
+                // Button events are already in logical coordinates
+                int x = event.button.x;
+                int y = event.button.y;
                 if (x >= restartButton.x && x <= restartButton.x + restartButton.w &&
                     y >= restartButton.y && y <= restartButton.y + restartButton.h) {
                     running = false;
@@ -369,7 +894,7 @@ bool gameOverMenu(SDL_Renderer* renderer, SDL_Texture* menuTexture) {
         }
 
         SDL_RenderClear(renderer);
-        SDL_RenderCopy(renderer, menuTexture, NULL, NULL);
+        SDL_RenderCopy(renderer, textureGet(textures, menuTexture), NULL, NULL);
 
         SDL_RenderCopy(renderer, restartTexture, NULL, &restartButton);
         SDL_RenderCopy(renderer, exitTexture, NULL, &exitButton);
@@ -384,100 +909,849 @@ bool gameOverMenu(SDL_Renderer* renderer, SDL_Texture* menuTexture) {
     return false;
 }
 
+bool parseOptions(int argc, char* argv[], Options* options) {
+    memset(options, 0, sizeof(*options));
+    options->windowWidth = WINDOW_WIDTH;
+    options->windowHeight = WINDOW_HEIGHT;
+    options->renderScale = 1.0f;
+    options->frameBudgetMs = 1000.0 / 60.0;
+    options->textureBudgetMb = TEXTURE_BUDGET_MB;
+    // Leave a core for the render and simulation threads
+    options->workers = SDL_GetCPUCount() - 1;
+    if (options->workers < 1) {
+        options->workers = 1;
+    } else if (options->workers > JOB_MAX_WORKERS) {
+        options->workers = JOB_MAX_WORKERS;
+    }
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--versus") == 0 && i + 4 < argc) {
+            options->versus = true;
+            options->localPlayer = atoi(argv[i + 1]) - 1;
+            options->localPort = atoi(argv[i + 2]);
+            options->remoteHost = argv[i + 3];
+            options->remotePort = atoi(argv[i + 4]);
+            i += 4;
+        } else if (strcmp(argv[i], "--spectate-port") == 0 && i + 1 < argc) {
+            options->spectatePort = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--spectate-remote") == 0) {
+            options->spectateRemote = true;
+        } else if (strcmp(argv[i], "--spectate-socket") == 0 && i + 1 < argc) {
+            options->spectateSocket = argv[++i];
+        } else if (strcmp(argv[i], "--window") == 0 && i + 1 < argc &&
+                   sscanf(argv[i + 1], "%dx%d", &options->windowWidth, &options->windowHeight) == 2) {
+            i++;
+        } else if (strcmp(argv[i], "--fullscreen") == 0) {
+            options->fullscreen = true;
+        } else if (strcmp(argv[i], "--render-scale") == 0 && i + 1 < argc) {
+            options->renderScale = (float)atof(argv[++i]);
+        } else if (strcmp(argv[i], "--frame-budget") == 0 && i + 1 < argc) {
+            options->frameBudgetMs = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--texture-budget") == 0 && i + 1 < argc) {
+            options->textureBudgetMb = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--workers") == 0 && i + 1 < argc) {
+            options->workers = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--homing") == 0 && i + 1 < argc) {
+            options->homingGhosts = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--bench-spectators") == 0 && i + 1 < argc) {
+            options->benchSpectators = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--bench-homing") == 0) {
+            options->benchHoming = true;
+        } else if (strcmp(argv[i], "--bench-jobs") == 0) {
+            options->benchJobs = true;
+        } else if (strcmp(argv[i], "--bench-collision") == 0) {
+            options->benchCollision = true;
+        } else {
+            std::cout << "Usage: " << argv[0] << " [--versus <player 1|2> <local port> <remote host> <remote port>]"
+                      << " [--spectate-port <port>] [--spectate-remote] [--spectate-socket <path>]"
+                      << " [--window <width>x<height>] [--fullscreen] [--render-scale <scale>] [--frame-budget <ms>]"
+                      << " [--texture-budget <MB>] [--workers <count>]"
+                      << " [--homing <count>] [--bench-collision] [--bench-jobs] [--bench-homing]"
+                      << " [--bench-spectators <count>]" << std::endl;
+            return false;
+        }
+    }
+
+    if (options->windowWidth <= 0 || options->windowHeight <= 0 || options->renderScale <= 0.0f || options->frameBudgetMs <= 0.0 || options->textureBudgetMb <= 0) {
+        std::cout << "Window size, render scale, frame budget and texture budget must be positive" << std::endl;
+        return false;
+    }
+
+    if (options->textureBudgetMb > TEXTURE_BUDGET_MAX_MB) {
+        std::cout << "Texture budget must be at most " << TEXTURE_BUDGET_MAX_MB << " MB" << std::endl;
+        return false;
+    }
+
+    if (options->workers < 0 || options->workers > JOB_MAX_WORKERS) {
+        std::cout << "Workers must be between 0 and " << JOB_MAX_WORKERS << std::endl;
+        return false;
+    }
+
+    if (options->homingGhosts < 0 || (options->versus && options->homingGhosts > 0)) {
+        std::cout << "Homing ghosts are for single player games only" << std::endl;
+        return false;
+    }
+
+    // Spectator frames carry only the big ghost
+    if (options->homingGhosts > 0 && (options->spectatePort > 0 || options->spectateSocket != NULL)) {
+        std::cout << "Homing ghosts cannot be spectated" << std::endl;
+        return false;
+    }
+
+    if (options->versus && (options->localPlayer < 0 || options->localPlayer >= MAX_PLAYERS)) {
+        std::cout << "Player must be 1 or 2" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+void fillSpectatorFrame(const GameState* game, SpectatorFrame* frame) {
+    memset(frame, 0, sizeof(*frame));
+    frame->values[SPEC_NUM_PLAYERS] = game->numPlayers;
+    frame->values[SPEC_SCORE] = game->score;
+
+    Sint32* ghost = &frame->values[SPEC_GHOST];
+    ghost[0] = game->ghost.rect.x;
+    ghost[1] = game->ghost.rect.y;
+    ghost[2] = game->ghost.rect.w;
+    ghost[3] = game->ghost.rect.h;
+    ghost[4] = game->ghost.active;
+
+    for (int i = 0; i < game->numPlayers; ++i) {
+        const Dinosaur* dino = &game->dinos[i];
+        Sint32* fields = &frame->values[SPEC_DINO(i)];
+        fields[0] = dino->rect.x;
+        fields[1] = dino->rect.y;
+        fields[2] = dino->rect.w;
+        fields[3] = dino->rect.h;
+        fields[4] = dino->velocity_y;
+        fields[5] = dino->velocity_x;
+        fields[6] = dino->jumpCount;
+    }
+}
+
+void publishSnapshot(Simulation* sim, bool hit) {
+    RenderSnapshot* snapshot = &sim->snapshots[sim->handoff.back];
+    const GameState* game = sim->game;
+    memcpy(snapshot->dinos, game->dinos, sizeof(snapshot->dinos));
+    snapshot->numPlayers = game->numPlayers;
+    snapshot->ghost = game->ghost;
+    snapshot->score = game->score;
+    snapshot->hit = hit;
+    if (sim->session != NULL) {
+        snapshot->netStats = sim->session->stats;
+    }
+    snapshot->numHoming = 0;
+    if (sim->homing != NULL) {
+        const HomingSwarm* swarm = sim->homing;
+        for (int i = 0; i < swarm->count; ++i) {
+            SDL_Rect rect = {(int)swarm->ghosts[i].x, (int)swarm->ghosts[i].y, HOMING_GHOST_SIZE, HOMING_GHOST_SIZE};
+            snapshot->homing[i] = rect;
+        }
+        snapshot->numHoming = swarm->count;
+    }
+    tripleBufferPublish(&sim->handoff);
+}
+
+// Runs one fixed step with the latest input. Returns true if a dino hit the
+// ghost in a single player game, with the command already moved from
+// SIM_RUN to SIM_PAUSED unless the game is quitting.
+bool stepSimulation(Simulation* sim) {
+    Uint8 input = (Uint8)SDL_AtomicGet(&sim->held);
+    // Presses since the last simulated frame make a single jump
+    int jumps = SDL_AtomicGet(&sim->jumps);
+    if (jumps > 0) {
+        input |= INPUT_JUMP;
+    }
+
+    bool hit = false;
+    bool simulated = true;
+    if (sim->session != NULL) {
+        // A waiting session leaves the jump latched for the frame it accepts
+        int events;
+        simulated = netplayAdvance(sim->session, input, &events);
+        playEventSounds(sim->audio, sim->sounds, events);
+    } else {
+        Uint8 inputs[MAX_PLAYERS] = {input, 0};
+        SDL_Rect prevDino = sim->game->dinos[0].rect;
+        hit = simulateStep(sim->game, inputs);
+        if (!hit && sim->homing != NULL && updateHoming(sim->jobs, sim->homing, &sim->game->dinos[0], &prevDino)) {
+            sim->game->events |= EVENT_HIT;
+            hit = true;
+        }
+        playEventSounds(sim->audio, sim->sounds, sim->game->events);
+    }
+    if (simulated && jumps > 0) {
+        SDL_AtomicAdd(&sim->jumps, -jumps);
+    }
+
+    if (sim->spectators != NULL) {
+        SpectatorFrame frame;
+        fillSpectatorFrame(sim->game, &frame);
+        spectatorPublish(sim->spectators, &frame);
+    }
+
+    // Pause before the hit is published, so the render thread can never
+    // answer the game over menu before there is a pause to answer
+    if (hit && !SDL_AtomicCAS(&sim->command, SIM_RUN, SIM_PAUSED)) {
+        return true;  // quitting
+    }
+    publishSnapshot(sim, hit);
+    return hit;
+}
+
+// Steps the game at SIM_STEPS_PER_SECOND regardless of how long frames take to render.
+int simulationThread(void* data) {
+    Simulation* sim = (Simulation*)data;
+    Uint64 frequency = SDL_GetPerformanceFrequency();
+    Uint64 period = frequency / SIM_STEPS_PER_SECOND;
+    Uint64 next = SDL_GetPerformanceCounter();
+
+    while (SDL_AtomicGet(&sim->command) != SIM_QUIT) {
+        if (stepSimulation(sim)) {
+            int command;
+            while ((command = SDL_AtomicGet(&sim->command)) == SIM_PAUSED) {
+                SDL_Delay(1);
+            }
+            if (command != SIM_RESTART) {
+                break;
+            }
+            resetRound(sim->game);
+            if (sim->homing != NULL) {
+                resetHoming(sim->homing, (Uint32)SDL_GetPerformanceCounter());
+            }
+            SDL_AtomicCAS(&sim->command, SIM_RESTART, SIM_RUN);
+            next = SDL_GetPerformanceCounter();
+        }
+
+        next += period;
+        Uint64 now = SDL_GetPerformanceCounter();
+        if (now < next) {
+            SDL_Delay((Uint32)((next - now) * 1000 / frequency));
+        } else if (now - next > period * 5) {
+            next = now;  // Too far behind to catch up; drop the missed steps
+        }
+    }
+    return 0;
+}
+
+// Times the mask test for the dino against the ghost at every offset where
+// their boxes overlap, which is the only case the narrowphase ever sees.
+int benchmarkCollision() {
+    CollisionMask dinoMask, ghostMask;
+    if (!collisionMaskLoad(&dinoMask, "dino.png", 145, 150)) {
+        return 1;
+    }
+    if (!collisionMaskLoad(&ghostMask, "ghost.png", 100, 100)) {
+        collisionMaskFree(&dinoMask);
+        return 1;
+    }
+
+    // Each offset is timed over several rounds, which keeps the timer's own
+    // cost out of the per-offset figure that the worst case is taken from
+    const int rounds = 20;
+    int pairs = 0;
+    int hits = 0;
+    Uint64 elapsed = 0;
+    Uint64 slowest = 0;
+    for (int y = -ghostMask.height + 1; y < dinoMask.height; ++y) {
+        for (int x = -ghostMask.width + 1; x < dinoMask.width; ++x) {
+            Uint64 start = SDL_GetPerformanceCounter();
+            for (int round = 0; round < rounds; ++round) {
+                hits += collisionMaskOverlap(&dinoMask, 0, 0, &ghostMask, x, y);
+            }
+            Uint64 offset = SDL_GetPerformanceCounter() - start;
+            elapsed += offset;
+            if (offset > slowest) {
+                slowest = offset;
+            }
+            pairs += rounds;
+        }
+    }
+
+    double nsPerTick = 1000000000.0 / SDL_GetPerformanceFrequency();
+    std::cout << "Collision: " << pairs << " overlapping pairs, " << 100.0 * hits / pairs << "% touching, "
+              << elapsed * nsPerTick / pairs << " ns per pair on average, worst offset "
+              << slowest * nsPerTick / rounds << " ns per pair" << std::endl;
+    collisionMaskFree(&dinoMask);
+    collisionMaskFree(&ghostMask);
+    return 0;
+}
+
+typedef struct {
+    const CollisionMask* dino;
+    const CollisionMask* ghost;
+    int* hits;  // per row of ghost offsets
+} CollisionSweep;
+
+// Tests the ghost against the dino at every horizontal offset for a range of
+// vertical offsets.
+void collisionSweepJob(void* data, int begin, int end) {
+    CollisionSweep* sweep = (CollisionSweep*)data;
+    for (int row = begin; row < end; ++row) {
+        int y = row - sweep->ghost->height + 1;
+        int hits = 0;
+        for (int x = -sweep->ghost->width + 1; x < sweep->dino->width; ++x) {
+            hits += collisionMaskOverlap(sweep->dino, 0, 0, sweep->ghost, x, y);
+        }
+        sweep->hits[row] = hits;
+    }
+}
+
+typedef struct {
+    const int* hits;
+    int rows;
+    int total;
+} HitTotal;
+
+void sumHitsJob(void* data, int begin, int end) {
+    (void)begin;
+    (void)end;
+    HitTotal* sum = (HitTotal*)data;
+    sum->total = 0;
+    for (int row = 0; row < sum->rows; ++row) {
+        sum->total += sum->hits[row];
+    }
+}
+
+// Times the same CPU-bound work, a full collision sweep, on 1 to
+// JOB_MAX_WORKERS threads. The thread that waits works too, so N threads
+// means N - 1 pool workers. Each pass totals the sweep in a job that depends
+// on the sweep jobs, and the total is checked against a serial run.
+int benchmarkJobs() {
+    CollisionMask dinoMask, ghostMask;
+    if (!collisionMaskLoad(&dinoMask, "dino.png", 145, 150)) {
+        return 1;
+    }
+    if (!collisionMaskLoad(&ghostMask, "ghost.png", 100, 100)) {
+        collisionMaskFree(&dinoMask);
+        return 1;
+    }
+
+    int rows = dinoMask.height + ghostMask.height - 1;
+    int* hits = (int*)calloc(rows, sizeof(int));
+    CollisionSweep sweep = {&dinoMask, &ghostMask, hits};
+    HitTotal sum = {hits, rows, 0};
+    collisionSweepJob(&sweep, 0, rows);
+    sumHitsJob(&sum, 0, 1);
+    int expected = sum.total;
+
+    int result = 0;
+    double baselineMs = 0.0;
+    for (int threads = 1; threads <= JOB_MAX_WORKERS; ++threads) {
+        JobSystem jobs;
+        if (!jobSystemInit(&jobs, threads - 1)) {
+            break;
+        }
+
+        const int passes = 20;
+        Uint64 start = SDL_GetPerformanceCounter();
+        for (int pass = 0; pass < passes && result == 0; ++pass) {
+            memset(hits, 0, rows * sizeof(int));
+            sum.total = -1;
+            JobCounter swept = {};
+            JobCounter summed = {};
+            jobParallelFor(&jobs, collisionSweepJob, &sweep, rows, 4, &swept);
+            jobSubmit(&jobs, sumHitsJob, &sum, 0, 1, &summed, &swept);
+            jobWait(&jobs, &summed);
+            if (sum.total != expected) {
+                std::cout << "Jobs Error: " << threads << " threads counted " << sum.total << " hits, expected " << expected << std::endl;
+                result = 1;
+            }
+        }
+        double ms = (double)(SDL_GetPerformanceCounter() - start) * 1000.0 / SDL_GetPerformanceFrequency() / passes;
+        jobSystemDestroy(&jobs);
+        if (result != 0) {
+            break;
+        }
+
+        if (threads == 1) {
+            baselineMs = ms;
+        }
+        std::cout << "Jobs: " << threads << " threads, " << ms << " ms per sweep, speedup " << baselineMs / ms << std::endl;
+    }
+
+    free(hits);
+    collisionMaskFree(&dinoMask);
+    collisionMaskFree(&ghostMask);
+    return result;
+}
+
+// Times homing ghost steps while the dino runs back and forth and jumps, so
+// the flow field keeps being rebuilt as it would in play.
+int benchmarkHoming(const Options* options) {
+    int count = options->homingGhosts > 0 ? options->homingGhosts : HOMING_BENCH_GHOSTS;
+    JobSystem jobs;
+    if (!jobSystemInit(&jobs, options->workers)) {
+        return 1;
+    }
+
+    // Without the images the test falls back to bounding boxes
+    CollisionMask dinoMask, homingMask;
+    bool dinoMasked = collisionMaskLoad(&dinoMask, "dino.png", 145, 150);
+    bool homingMasked = collisionMaskLoad(&homingMask, "ghost.png", HOMING_GHOST_SIZE, HOMING_GHOST_SIZE);
+
+    HomingSwarm swarm;
+    if (!homingInit(&swarm, count, homingMasked ? &homingMask : NULL)) {
+        jobSystemDestroy(&jobs);
+        return 1;
+    }
+    resetHoming(&swarm, 1);
+    Dinosaur dino = {TEXTURE_INVALID, {320, WINDOW_HEIGHT - GROUND_HEIGHT - 150, 145, 150}, 0, 0, 0, dinoMasked ? &dinoMask : NULL};
+
+    const int steps = 600;
+    int hitSteps = 0;
+    double totalMs = 0.0;
+    double maxMs = 0.0;
+    for (int step = 0; step < steps; ++step) {
+        Uint8 input = ((step / 80) & 1) ? INPUT_LEFT : INPUT_RIGHT;
+        if (step % 45 == 0) {
+            input |= INPUT_JUMP;
+        }
+        SDL_Rect prevDino = dino.rect;
+        applyInput(&dino, input);
+        updateDino(&dino);
+
+        Uint64 start = SDL_GetPerformanceCounter();
+        hitSteps += updateHoming(&jobs, &swarm, &dino, &prevDino);
+        double ms = (double)(SDL_GetPerformanceCounter() - start) * 1000.0 / SDL_GetPerformanceFrequency();
+        totalMs += ms;
+        if (ms > maxMs) {
+            maxMs = ms;
+        }
+    }
+
+    const FlowField* field = &swarm.field;
+    std::cout << "Homing: " << count << " ghosts on " << jobs.numWorkers << " workers, "
+              << totalMs / steps << " ms avg, " << maxMs << " ms max per step, "
+              << hitSteps << " of " << steps << " steps touching the dino, flow field rebuilt "
+              << field->recomputes << " times (avg "
+              << (field->recomputes ? field->totalRecomputeNs / field->recomputes / 1000.0 : 0.0) << " us, max "
+              << field->maxRecomputeNs / 1000.0 << " us)" << std::endl;
+
+    homingFree(&swarm);
+    if (dinoMasked) {
+        collisionMaskFree(&dinoMask);
+    }
+    if (homingMasked) {
+        collisionMaskFree(&homingMask);
+    }
+    jobSystemDestroy(&jobs);
+    return 0;
+}
+
+typedef struct {
+    int epollFd;
+    SDL_atomic_t stop;
+} SpectatorDrain;
+
+// Stands in for the viewers: reads and discards everything the server sends.
+int spectatorDrainThread(void* data) {
+    SpectatorDrain* drain = (SpectatorDrain*)data;
+    struct epoll_event events[64];
+    unsigned char discard[4096];
+    while (!SDL_AtomicGet(&drain->stop)) {
+        int ready = epoll_wait(drain->epollFd, events, 64, 10);
+        for (int i = 0; i < ready; ++i) {
+            while (recv(events[i].data.fd, discard, sizeof(discard), MSG_DONTWAIT) > 0) {
+            }
+        }
+    }
+    return 0;
+}
+
+// Steps a single player game for a few seconds at SIM_STEPS_PER_SECOND,
+// publishing every step, and prints the 95th percentile step time and the
+// publish cost on the game thread.
+void benchmarkSpectatorPhase(SpectatorServer* server, GameState* game, int subscribers) {
+    const int steps = SIM_STEPS_PER_SECOND * 5;
+    double* stepMs = (double*)malloc(steps * sizeof(double));
+    if (stepMs == NULL) {
+        return;
+    }
+    server->stats.publishes = 0;
+    server->stats.totalPublishMs = 0.0;
+    server->stats.maxPublishMs = 0.0;
+
+    Uint64 frequency = SDL_GetPerformanceFrequency();
+    Uint64 period = frequency / SIM_STEPS_PER_SECOND;
+    Uint64 next = SDL_GetPerformanceCounter();
+    for (int step = 0; step < steps; ++step) {
+        Uint64 start = SDL_GetPerformanceCounter();
+        Uint8 inputs[MAX_PLAYERS] = {(Uint8)(step % 40 == 0 ? INPUT_JUMP : 0), 0};
+        if (simulateStep(game, inputs)) {
+            resetRound(game);
+        }
+        SpectatorFrame frame;
+        fillSpectatorFrame(game, &frame);
+        spectatorPublish(server, &frame);
+        stepMs[step] = (double)(SDL_GetPerformanceCounter() - start) * 1000.0 / frequency;
+
+        next += period;
+        Uint64 now = SDL_GetPerformanceCounter();
+        if (now < next) {
+            SDL_Delay((Uint32)((next - now) * 1000 / frequency));
+        }
+    }
+
+    qsort(stepMs, steps, sizeof(double), qualityCompare);
+    const SpectatorStats* stats = &server->stats;
+    std::cout << "Spectators: " << subscribers << " subscribers, p95 step " << stepMs[steps * 95 / 100] << " ms, max "
+              << stepMs[steps - 1] << " ms, publish avg " << stats->totalPublishMs / stats->publishes << " ms, max "
+              << stats->maxPublishMs << " ms" << std::endl;
+    free(stepMs);
+}
+
+// Measures what spectators cost the game: the same run with no subscribers,
+// then with count subscribers connected over loopback TCP.
+int benchmarkSpectators(const Options* options) {
+    int port = options->spectatePort > 0 ? options->spectatePort : 7100;
+    SpectatorServer server;
+    if (!spectatorStart(&server, port, false, NULL)) {
+        return 1;
+    }
+
+    GameState game = {};
+    game.numPlayers = 1;
+    game.dinos[0] = {TEXTURE_INVALID, {320, WINDOW_HEIGHT - GROUND_HEIGHT - 150, 145, 150}, 0, 0, 0, NULL};
+    game.ghost = {TEXTURE_INVALID, {0, WINDOW_HEIGHT - GROUND_HEIGHT - 80, 100, 100}, 3, true, NULL};
+    benchmarkSpectatorPhase(&server, &game, 0);
+
+    SpectatorDrain drain;
+    drain.epollFd = epoll_create1(EPOLL_CLOEXEC);
+    SDL_AtomicSet(&drain.stop, 0);
+    int* fds = (int*)malloc(options->benchSpectators * sizeof(int));
+    int connected = 0;
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = htons(port);
+    while (fds != NULL && connected < options->benchSpectators) {
+        int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd < 0 || connect(fd, (struct sockaddr*)&address, sizeof(address)) != 0) {
+            std::cout << "Spectator Connect Error: " << strerror(errno) << std::endl;
+            if (fd >= 0) {
+                close(fd);
+            }
+            break;
+        }
+        struct epoll_event event;
+        event.events = EPOLLIN;
+        event.data.fd = fd;
+        epoll_ctl(drain.epollFd, EPOLL_CTL_ADD, fd, &event);
+        fds[connected++] = fd;
+    }
+
+    SDL_Thread* thread = SDL_CreateThread(spectatorDrainThread, "drain", &drain);
+    // Let the server accept everyone before timing
+    SDL_Delay(500);
+    benchmarkSpectatorPhase(&server, &game, connected);
+
+    SDL_AtomicSet(&drain.stop, 1);
+    if (thread != NULL) {
+        SDL_WaitThread(thread, NULL);
+    }
+    spectatorStop(&server);
+    std::cout << "Spectators: " << server.stats.accepted << " accepted, " << server.stats.dropped << " dropped for falling behind" << std::endl;
+    for (int i = 0; i < connected; ++i) {
+        close(fds[i]);
+    }
+    free(fds);
+    close(drain.epollFd);
+    return connected == options->benchSpectators ? 0 : 1;
+}
+
 int main(int argc, char* argv[]) {
+    Options options;
+    if (!parseOptions(argc, argv, &options)) {
+        return 1;
+    }
+    if (options.benchCollision) {
+        return benchmarkCollision();
+    }
+    if (options.benchJobs) {
+        return benchmarkJobs();
+    }
+    if (options.benchHoming) {
+        return benchmarkHoming(&options);
+    }
+    if (options.benchSpectators > 0) {
+        return benchmarkSpectators(&options);
+    }
+    bool versus = options.versus;
+    int localPlayer = options.localPlayer;
+
     SDL_Window* window = NULL;
     SDL_Renderer* renderer = NULL;
+    JobSystem jobs;
 
-    if (!init(&window, &renderer)) {
+    if (!init(&window, &renderer, &jobs, &options)) {
         return 1;
     }
 
-    SDL_Texture* menuTexture = loadTexture("menu.jpg", renderer);
-    if (menuTexture == NULL) {
-        SDL_DestroyRenderer(renderer);
-        SDL_DestroyWindow(window);
-        IMG_Quit();
-        SDL_Quit();
+    TextureCache textures;
+    textureCacheInit(&textures, renderer, options.textureBudgetMb * 1024 * 1024);
+    // Build the ground on a worker while every image decodes in parallel
+    Stone stones[NUM_STONES];
+    StoneBatch stoneBatch = {stones, (Uint32)rand()};
+    JobCounter groundReady = {};
+    jobSubmit(&jobs, generateStonesJob, &stoneBatch, 0, NUM_STONES, &groundReady, NULL);
+    const char* const textureFiles[] = {"menu.jpg", "dino.png", "ghost.png", "tree.png", "cloud.png"};
+    textureCachePreload(&textures, &jobs, textureFiles, (int)(sizeof(textureFiles) / sizeof(textureFiles[0])));
+    jobWait(&jobs, &groundReady);
+
+    TextureHandle menuTexture = textureAcquire(&textures, "menu.jpg");
+    if (menuTexture == TEXTURE_INVALID) {
+        cleanUp(window, renderer, &jobs, &textures, NULL);
         return 1;
     }
 
-    if (!mainMenu(renderer, menuTexture)) {
-        cleanUp(window, renderer, NULL, NULL, NULL, NULL, menuTexture);
+    if (!mainMenu(renderer, &textures, menuTexture)) {
+        cleanUp(window, renderer, &jobs, &textures, NULL);
         return 0;
     }
-
-    Dinosaur dino = {NULL, {320, WINDOW_HEIGHT - GROUND_HEIGHT, 145, 150}, 0, 0, 30};
-    Ghost ghost = {NULL, {0, WINDOW_HEIGHT - GROUND_HEIGHT - 80, 100, 100}, 3, true};
-    SDL_Texture* treeTexture = NULL;
-    SDL_Texture* cloudTexture = NULL;
-
-    dino.texture = loadTexture("dino.png", renderer);
-    if (dino.texture == NULL) {
-        cleanUp(window, renderer, &dino, &ghost, treeTexture, cloudTexture, menuTexture);
+    // Not needed again until game over; freed once the game's own textures are held
+    textureRelease(&textures, menuTexture);
+
+    GameState game = {};
+    game.numPlayers = versus ? 2 : 1;
+    Dinosaur& dino = game.dinos[0];
+    Ghost& ghost = game.ghost;
+    dino = {TEXTURE_INVALID, {320, WINDOW_HEIGHT - GROUND_HEIGHT, 145, 150}, 0, 0, 30, NULL};
+    ghost = {TEXTURE_INVALID, {0, WINDOW_HEIGHT - GROUND_HEIGHT - 80, 100, 100}, 3, true, NULL};
+
+    dino.texture = textureAcquire(&textures, "dino.png");
+    if (dino.texture == TEXTURE_INVALID) {
+        cleanUp(window, renderer, &jobs, &textures, NULL);
         return 1;
     }
+    game.dinos[1] = dino;
+    game.dinos[1].rect.x = 520;
 
-    ghost.texture = loadTexture("ghost.png", renderer);
-    if (ghost.texture == NULL) {
-        cleanUp(window, renderer, &dino, &ghost, treeTexture, cloudTexture, menuTexture);
+    ghost.texture = textureAcquire(&textures, "ghost.png");
+    if (ghost.texture == TEXTURE_INVALID) {
+        cleanUp(window, renderer, &jobs, &textures, NULL);
         return 1;
     }
 
-    treeTexture = loadTexture("tree.png", renderer);
-    if (treeTexture == NULL) {
-        cleanUp(window, renderer, &dino, &ghost, treeTexture, cloudTexture, menuTexture);
+    TextureHandle treeTexture = textureAcquire(&textures, "tree.png");
+    if (treeTexture == TEXTURE_INVALID) {
+        cleanUp(window, renderer, &jobs, &textures, NULL);
         return 1;
     }
 
-    cloudTexture = loadTexture("cloud.png", renderer);
-    if (cloudTexture == NULL) {
-        cleanUp(window, renderer, &dino, &ghost, treeTexture, cloudTexture, menuTexture);
+    TextureHandle cloudTexture = textureAcquire(&textures, "cloud.png");
+    if (cloudTexture == TEXTURE_INVALID) {
+        cleanUp(window, renderer, &jobs, &textures, NULL);
         return 1;
     }
+    // Everything still resident but unreferenced only served the menu
+    textureCacheTrim(&textures);
 
     TTF_Font *font1 = TTF_OpenFont("arial.ttf",24);
     if(!font1){
         std::cout<<"Failed to load due to: "<<TTF_GetError()<<std::endl;
     }
 
-    // Initialize stone positions and sizes
-    Stone stones[NUM_STONES];
-    for (int i = 0; i < NUM_STONES; ++i) {
-        stones[i].x = rand() % WINDOW_WIDTH;
-        stones[i].y = rand() % (GROUND_HEIGHT / 2) + (WINDOW_HEIGHT - GROUND_HEIGHT / 2);
-        stones[i].size = rand() % 10 + 5;
+    // Sound effects are decoded up front; the game runs silently without an audio device
+    AudioEngine audio;
+    memset(&audio, 0, sizeof(audio));
+    SoundEffects sounds = {-1, -1, -1};
+    if (SDL_InitSubSystem(SDL_INIT_AUDIO) != 0) {
+        std::cout << "Audio Init Error: " << SDL_GetError() << std::endl;
+    } else if (audioOpen(&audio)) {
+        sounds.jump = audioLoadEffect(&audio, "jump.wav", 0.15f, 300.0f, 750.0f, 0.0f);
+        sounds.land = audioLoadEffect(&audio, "land.wav", 0.08f, 120.0f, 60.0f, 0.4f);
+        sounds.hit = audioLoadEffect(&audio, "hit.wav", 0.35f, 450.0f, 90.0f, 0.25f);
+        audioStart(&audio);
     }
 
+    NetplaySession session;
+    if (versus) {
+        if (!netplayOpen(&session, localPlayer, options.localPort, options.remoteHost, options.remotePort, &game, sizeof(game), advanceVersusFrame)) {
+            audioClose(&audio);
+            cleanUp(window, renderer, &jobs, &textures, font1);
+            return 1;
+        }
+    }
+
+    SpectatorServer spectators;
+    bool spectating = options.spectatePort > 0 || options.spectateSocket != NULL;
+    if (spectating && !spectatorStart(&spectators, options.spectatePort, options.spectateRemote, options.spectateSocket)) {
+        if (versus) {
+            netplayClose(&session);
+        }
+        audioClose(&audio);
+        cleanUp(window, renderer, &jobs, &textures, font1);
+        return 1;
+    }
+
+    // Collide on opaque pixels; without a mask the box alone decides
+    CollisionMask dinoMask, ghostMask;
+    if (collisionMaskLoad(&dinoMask, "dino.png", dino.rect.w, dino.rect.h)) {
+        for (int i = 0; i < MAX_PLAYERS; ++i) {
+            game.dinos[i].mask = &dinoMask;
+        }
+    }
+    if (collisionMaskLoad(&ghostMask, "ghost.png", ghost.rect.w, ghost.rect.h)) {
+        ghost.mask = &ghostMask;
+    }
+
+    // Homing ghosts are optional; the game goes on without them if they cannot be set up
+    CollisionMask homingMask;
+    memset(&homingMask, 0, sizeof(homingMask));
+    HomingSwarm homing;
+    bool homingEnabled = false;
+    SDL_Rect* homingRects = NULL;  // one array per snapshot slot
+    if (options.homingGhosts > 0) {
+        collisionMaskLoad(&homingMask, "ghost.png", HOMING_GHOST_SIZE, HOMING_GHOST_SIZE);
+        homingEnabled = homingInit(&homing, options.homingGhosts, homingMask.bits != NULL ? &homingMask : NULL);
+        if (homingEnabled) {
+            homingRects = (SDL_Rect*)calloc(3 * homing.count, sizeof(SDL_Rect));
+            if (homingRects == NULL) {
+                std::cout << "Homing Ghost Error: out of memory" << std::endl;
+                homingFree(&homing);
+                homingEnabled = false;
+            } else {
+                resetHoming(&homing, (Uint32)rand());
+            }
+        }
+    }
+
+    Simulation sim;
+    memset(&sim, 0, sizeof(sim));
+    sim.game = &game;
+    sim.session = versus ? &session : NULL;
+    sim.spectators = spectating ? &spectators : NULL;
+    sim.homing = homingEnabled ? &homing : NULL;
+    sim.jobs = &jobs;
+    for (int i = 0; i < 3 && homingEnabled; ++i) {
+        sim.snapshots[i].homing = homingRects + i * homing.count;
+    }
+    sim.audio = &audio;
+    sim.sounds = &sounds;
+    SDL_AtomicSet(&sim.command, SIM_RUN);
+    tripleBufferInit(&sim.handoff);
+    publishSnapshot(&sim, false);
+    tripleBufferAcquire(&sim.handoff);
+
+    SDL_Thread* simThread = SDL_CreateThread(simulationThread, "simulation", &sim);
+    if (simThread == NULL) {
+        std::cout << "Simulation Thread Error: " << SDL_GetError() << std::endl;
+        if (spectating) {
+            spectatorStop(&spectators);
+        }
+        if (versus) {
+            netplayClose(&session);
+        }
+        audioClose(&audio);
+        collisionMaskFree(&dinoMask);
+        collisionMaskFree(&ghostMask);
+        if (homingEnabled) {
+            homingFree(&homing);
+        }
+        free(homingRects);
+        collisionMaskFree(&homingMask);
+        cleanUp(window, renderer, &jobs, &textures, font1);
+        return 1;
+    }
+
+    Scene scene;
+    sceneInit(&scene, WINDOW_WIDTH, WINDOW_HEIGHT);
+    RenderQueue renderQueue;
+    renderQueueInit(&renderQueue);
+    QualityGovernor governor;
+    qualityInit(&governor, options.frameBudgetMs, options.renderScale);
+
     bool running = true;
-    int score = 0;
+    bool showOverlay = false;
+    Uint8 input = 0;
+    Uint32 lastTitleUpdate = 0;
+    Uint64 frequency = SDL_GetPerformanceFrequency();
+    Uint64 frameStart = SDL_GetPerformanceCounter();
 
     while (running) {
-        handleEvents(&running, &dino);
-        updateDino(&dino);
-
-        if (!ghost.active) {
-            ghost.rect.x = 0;
-            ghost.rect.y = WINDOW_HEIGHT - GROUND_HEIGHT - 80;
-            ghost.active = true;
-            ghost.velocity_x += 1;  // Increase the speed of the ghost
+        handleEvents(&running, &input, &showOverlay);
+        SDL_AtomicSet(&sim.held, input & (INPUT_LEFT | INPUT_RIGHT));
+        if (input & INPUT_JUMP) {
+            SDL_AtomicAdd(&sim.jumps, 1);
         }
-        updateGhost(&ghost);
 
-        if (checkCollision(&dino.rect, &ghost.rect)) {
-            if (!gameOverMenu(renderer, menuTexture)) {
+        bool fresh = tripleBufferAcquire(&sim.handoff);
+        RenderSnapshot* snapshot = &sim.snapshots[sim.handoff.front];
+
+        if (fresh && snapshot->hit) {
+            // The simulation waits for the answer before stepping again
+            textureRetain(&textures, menuTexture);
+            if (!gameOverMenu(renderer, &textures, menuTexture)) {
                 running = false;
             } else {
-                // Reset the game state
-                dino.rect.x = 320;
-                dino.rect.y = WINDOW_HEIGHT - GROUND_HEIGHT - dino.rect.h;
-                ghost.rect.x = 0;
-                score = 0;
+                SDL_AtomicCAS(&sim.command, SIM_PAUSED, SIM_RESTART);
             }
+            textureRelease(&textures, menuTexture);
+            textureCacheTrim(&textures);
+            frameStart = SDL_GetPerformanceCounter();
+            continue;
         }
 
-        render(renderer, &dino, &ghost, treeTexture, cloudTexture, stones, NUM_STONES);
+        // Show rollback statistics once a second
+        if (versus && SDL_GetTicks() - lastTitleUpdate >= 1000) {
+            char title[128];
+            snprintf(title, sizeof(title), "Jumping Dino - P%d - rollback %d (max %d) - resim %.3f ms (max %.3f ms)",
+                     localPlayer + 1, snapshot->netStats.lastRollbackDepth, snapshot->netStats.maxRollbackDepth,
+                     snapshot->netStats.lastResimMs, snapshot->netStats.maxResimMs);
+            SDL_SetWindowTitle(window, title);
+            lastTitleUpdate = SDL_GetTicks();
+        }
+
+        sceneBegin(renderer, &scene, qualityRenderScale(&governor));
+        render(renderer, &renderQueue, &textures, snapshot->dinos, snapshot->numPlayers, &snapshot->ghost, snapshot->homing, snapshot->numHoming, treeTexture, cloudTexture, stones, NUM_STONES, qualityCurrent(&governor));
+        if (showOverlay) {
+            char lines[OVERLAY_LINES][256];
+            int numLines = 0;
+            snprintf(lines[numLines++], sizeof(lines[0]), "Quality level %d, render scale %.2f, p95 work %.2f ms, frame %.2f ms",
+                     governor.level, qualityRenderScale(&governor), governor.p95WorkMs, governor.p95FrameMs);
+            renderQueueDescribe(&renderQueue, lines[numLines++], sizeof(lines[0]));
+            textureCacheDescribe(&textures, lines[numLines++], sizeof(lines[0]));
+            renderOverlay(renderer, font1, lines, numLines);
+        }
+        Uint64 workEnd = SDL_GetPerformanceCounter();
+        scenePresent(renderer, &scene);
+
+        Uint64 frameEnd = SDL_GetPerformanceCounter();
+        qualityRecord(&governor, (double)(frameEnd - frameStart) * 1000.0 / frequency, (double)(workEnd - frameStart) * 1000.0 / frequency);
+        frameStart = frameEnd;
+    }
+
+    renderQueueDestroy(&renderQueue);
+    sceneDestroy(&scene);
+    qualityPrintStats(&governor);
+
+    SDL_AtomicSet(&sim.command, SIM_QUIT);
+    SDL_WaitThread(simThread, NULL);
+
+    if (spectating) {
+        spectatorStop(&spectators);
+        spectatorPrintStats(&spectators);
     }
 
-    cleanUp(window, renderer, &dino, &ghost, treeTexture, cloudTexture, menuTexture);
+    if (versus) {
+        netplayPrintStats(&session);
+        netplayClose(&session);
+    }
+
+    audioClose(&audio);
+    audioPrintStats(&audio);
+    textureCachePrintStats(&textures);
+    jobSystemPrintStats(&jobs);
+
+    collisionMaskFree(&dinoMask);
+    collisionMaskFree(&ghostMask);
+    if (homingEnabled) {
+        homingFree(&homing);
+    }
+    free(homingRects);
+    collisionMaskFree(&homingMask);
+    cleanUp(window, renderer, &jobs, &textures, font1);
     return 0;
 }
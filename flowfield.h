@@ -0,0 +1,192 @@
+#ifndef FLOWFIELD_H
+#define FLOWFIELD_H
+
+// Grid flow field towards a single target.
+//
+// The playfield is split into square cells. Whenever the target moves into a
+// different cell, a breadth-first search from that cell gives every open cell
+// its step distance to the target, and each cell then stores a unit vector
+// towards its closest neighbour (diagonals only where both sides are open,
+// so nothing cuts a corner). Any number of followers steer with a single
+// lookup of the cell they are in. The cost of following does not depend on
+// how far away the target is or how many followers there are.
+
+#include <SDL2/SDL.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define FLOW_UNREACHABLE 0xFFFF
+
+typedef struct {
+    int columns;
+    int rows;
+    int cellSize;
+    Uint8* blocked;
+    Uint16* distance;        // steps to the target cell, FLOW_UNREACHABLE if cut off
+    float* directionX;       // unit vector towards the target, 0 in the target cell
+    float* directionY;
+    int* queue;
+    int targetCell;          // -1 until the first update
+    int recomputes;
+    Uint64 totalRecomputeNs;
+    Uint64 maxRecomputeNs;
+} FlowField;
+
+inline void flowFieldFree(FlowField* field) {
+    free(field->blocked);
+    free(field->distance);
+    free(field->directionX);
+    free(field->directionY);
+    free(field->queue);
+    memset(field, 0, sizeof(*field));
+}
+
+inline bool flowFieldInit(FlowField* field, int width, int height, int cellSize) {
+    memset(field, 0, sizeof(*field));
+    field->columns = (width + cellSize - 1) / cellSize;
+    field->rows = (height + cellSize - 1) / cellSize;
+    field->cellSize = cellSize;
+    field->targetCell = -1;
+    int cells = field->columns * field->rows;
+    field->blocked = (Uint8*)calloc(cells, sizeof(Uint8));
+    field->distance = (Uint16*)malloc(cells * sizeof(Uint16));
+    field->directionX = (float*)calloc(cells, sizeof(float));
+    field->directionY = (float*)calloc(cells, sizeof(float));
+    field->queue = (int*)malloc(cells * sizeof(int));
+    if (!field->blocked || !field->distance || !field->directionX || !field->directionY || !field->queue) {
+        flowFieldFree(field);
+        return false;
+    }
+    return true;
+}
+
+// Cell index for a point, or -1 outside the grid.
+inline int flowFieldCell(const FlowField* field, float x, float y) {
+    if (x < 0.0f || y < 0.0f) {
+        return -1;
+    }
+    int column = (int)x / field->cellSize;
+    int row = (int)y / field->cellSize;
+    if (column >= field->columns || row >= field->rows) {
+        return -1;
+    }
+    return row * field->columns + column;
+}
+
+// Marks every cell the rectangle touches as impassable. Takes effect at the
+// next recompute.
+inline void flowFieldBlock(FlowField* field, const SDL_Rect* rect) {
+    for (int row = 0; row < field->rows; ++row) {
+        for (int column = 0; column < field->columns; ++column) {
+            int x = column * field->cellSize;
+            int y = row * field->cellSize;
+            if (x < rect->x + rect->w && x + field->cellSize > rect->x && y < rect->y + rect->h && y + field->cellSize > rect->y) {
+                field->blocked[row * field->columns + column] = 1;
+            }
+        }
+    }
+    field->targetCell = -1;
+}
+
+inline void flowFieldRecompute(FlowField* field) {
+    int cells = field->columns * field->rows;
+    for (int i = 0; i < cells; ++i) {
+        field->distance[i] = FLOW_UNREACHABLE;
+    }
+
+    // Breadth-first over the four orthogonal neighbours
+    int head = 0;
+    int tail = 0;
+    field->distance[field->targetCell] = 0;
+    field->queue[tail++] = field->targetCell;
+    while (head < tail) {
+        int cell = field->queue[head++];
+        int column = cell % field->columns;
+        int row = cell / field->columns;
+        Uint16 next = field->distance[cell] + 1;
+        int neighbours[4] = {
+            column > 0 ? cell - 1 : -1,
+            column + 1 < field->columns ? cell + 1 : -1,
+            row > 0 ? cell - field->columns : -1,
+            row + 1 < field->rows ? cell + field->columns : -1,
+        };
+        for (int n = 0; n < 4; ++n) {
+            int neighbour = neighbours[n];
+            if (neighbour >= 0 && !field->blocked[neighbour] && field->distance[neighbour] == FLOW_UNREACHABLE) {
+                field->distance[neighbour] = next;
+                field->queue[tail++] = neighbour;
+            }
+        }
+    }
+
+    // Point each cell at its closest neighbour, diagonals included
+    static const float DIAGONAL = 0.70710678f;
+    for (int cell = 0; cell < cells; ++cell) {
+        field->directionX[cell] = 0.0f;
+        field->directionY[cell] = 0.0f;
+        Uint16 best = field->distance[cell];
+        if (best == 0 || best == FLOW_UNREACHABLE) {
+            continue;
+        }
+        int column = cell % field->columns;
+        int row = cell / field->columns;
+        int bestX = 0;
+        int bestY = 0;
+        for (int dy = -1; dy <= 1; ++dy) {
+            for (int dx = -1; dx <= 1; ++dx) {
+                int x = column + dx;
+                int y = row + dy;
+                if ((dx == 0 && dy == 0) || x < 0 || y < 0 || x >= field->columns || y >= field->rows) {
+                    continue;
+                }
+                if (dx != 0 && dy != 0 &&
+                    (field->blocked[row * field->columns + x] || field->blocked[y * field->columns + column])) {
+                    continue;
+                }
+                Uint16 distance = field->distance[y * field->columns + x];
+                if (distance < best) {
+                    best = distance;
+                    bestX = dx;
+                    bestY = dy;
+                }
+            }
+        }
+        float scale = (bestX != 0 && bestY != 0) ? DIAGONAL : 1.0f;
+        field->directionX[cell] = bestX * scale;
+        field->directionY[cell] = bestY * scale;
+    }
+}
+
+// Moves the target to (x, y). The field is only rebuilt when that is a new
+// open cell. Returns true if it was rebuilt.
+inline bool flowFieldUpdate(FlowField* field, float x, float y) {
+    int cell = flowFieldCell(field, x, y);
+    if (cell < 0 || cell == field->targetCell || field->blocked[cell]) {
+        return false;
+    }
+    Uint64 start = SDL_GetPerformanceCounter();
+    field->targetCell = cell;
+    flowFieldRecompute(field);
+    Uint64 elapsed = (SDL_GetPerformanceCounter() - start) * 1000000000ull / SDL_GetPerformanceFrequency();
+    field->recomputes++;
+    field->totalRecomputeNs += elapsed;
+    if (elapsed > field->maxRecomputeNs) {
+        field->maxRecomputeNs = elapsed;
+    }
+    return true;
+}
+
+// Unit direction towards the target for a follower at (x, y). Returns false
+// in the target cell, outside the grid or where the target cannot be reached;
+// the follower should then head straight for the target.
+inline bool flowFieldSteer(const FlowField* field, float x, float y, float* dx, float* dy) {
+    int cell = flowFieldCell(field, x, y);
+    if (cell < 0) {
+        return false;
+    }
+    *dx = field->directionX[cell];
+    *dy = field->directionY[cell];
+    return *dx != 0.0f || *dy != 0.0f;
+}
+
+#endif
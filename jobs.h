@@ -0,0 +1,297 @@
+#ifndef JOBS_H
+#define JOBS_H
+
+// Work-stealing job system.
+//
+// Each worker thread owns a deque of jobs. It pushes and pops its own jobs at
+// the bottom and, when it runs dry, steals the oldest job from the top of
+// another worker's deque. Threads outside the pool submit into one shared
+// deque that every worker steals from. A job can count down a JobCounter when
+// it finishes and can name another counter that must reach zero before it
+// runs; a worker that picks it up early helps run other jobs until then.
+// jobWait() never just sleeps: the waiting thread runs queued jobs until the
+// counter drops to zero, so waiting inside a job cannot deadlock the pool.
+// Idle workers sleep on a semaphore that is posted only as often as there
+// are workers asleep to take the posts.
+
+#include <SDL2/SDL.h>
+#include <iostream>
+#include <stdio.h>
+#include <string.h>
+
+#define JOB_MAX_WORKERS 16
+#define JOB_QUEUE_SIZE 1024  // per deque, power of two
+#define JOB_SHARED JOB_MAX_WORKERS  // deque used by threads outside the pool
+
+typedef void (*JobFunction)(void* data, int begin, int end);
+
+typedef struct {
+    SDL_atomic_t pending;
+} JobCounter;
+
+typedef struct {
+    JobFunction function;
+    void* data;
+    int begin;
+    int end;
+    JobCounter* counter;     // counted down when the job finishes, or NULL
+    JobCounter* dependency;  // must reach zero before the job runs, or NULL
+} Job;
+
+typedef struct {
+    SDL_SpinLock lock;
+    int top;                 // thieves take from here
+    int bottom;              // the owner pushes and pops here
+    Job jobs[JOB_QUEUE_SIZE];
+} JobDeque;
+
+struct JobSystem;
+
+typedef struct {
+    struct JobSystem* system;
+    int index;
+    SDL_Thread* thread;
+    int executed;            // written by the worker only
+    int stolen;
+} JobWorker;
+
+typedef struct JobSystem {
+    int numWorkers;
+    JobWorker workers[JOB_MAX_WORKERS];
+    JobDeque deques[JOB_MAX_WORKERS + 1];  // one per worker, then JOB_SHARED
+    SDL_sem* wake;
+    SDL_atomic_t sleeping;                  // workers waiting on wake that nobody has posted for yet
+    SDL_atomic_t quit;
+} JobSystem;
+
+// Worker index of the calling thread, or -1 outside the pool.
+inline int* jobThreadIndex() {
+    static thread_local int index = -1;
+    return &index;
+}
+
+inline JobDeque* jobOwnDeque(JobSystem* system) {
+    int index = *jobThreadIndex();
+    return &system->deques[index >= 0 ? index : JOB_SHARED];
+}
+
+inline bool jobDequePush(JobDeque* deque, const Job* job) {
+    SDL_AtomicLock(&deque->lock);
+    bool pushed = deque->bottom - deque->top < JOB_QUEUE_SIZE;
+    if (pushed) {
+        deque->jobs[deque->bottom & (JOB_QUEUE_SIZE - 1)] = *job;
+        deque->bottom++;
+    }
+    SDL_AtomicUnlock(&deque->lock);
+    return pushed;
+}
+
+// Newest job, for the owner.
+inline bool jobDequePop(JobDeque* deque, Job* job) {
+    SDL_AtomicLock(&deque->lock);
+    bool popped = deque->bottom > deque->top;
+    if (popped) {
+        deque->bottom--;
+        *job = deque->jobs[deque->bottom & (JOB_QUEUE_SIZE - 1)];
+    }
+    SDL_AtomicUnlock(&deque->lock);
+    return popped;
+}
+
+// Oldest job, for thieves.
+inline bool jobDequeSteal(JobDeque* deque, Job* job) {
+    SDL_AtomicLock(&deque->lock);
+    bool stolen = deque->bottom > deque->top;
+    if (stolen) {
+        *job = deque->jobs[deque->top & (JOB_QUEUE_SIZE - 1)];
+        deque->top++;
+    }
+    SDL_AtomicUnlock(&deque->lock);
+    return stolen;
+}
+
+inline bool jobTryRun(JobSystem* system);
+
+// Blocks until counter reaches zero, running other jobs meanwhile.
+inline void jobWait(JobSystem* system, JobCounter* counter) {
+    while (SDL_AtomicGet(&counter->pending) > 0) {
+        if (!jobTryRun(system)) {
+            SDL_Delay(0);
+        }
+    }
+}
+
+inline void jobRun(JobSystem* system, const Job* job) {
+    if (job->dependency != NULL) {
+        jobWait(system, job->dependency);
+    }
+    job->function(job->data, job->begin, job->end);
+    if (job->counter != NULL) {
+        SDL_AtomicAdd(&job->counter->pending, -1);
+    }
+}
+
+inline bool jobAnyQueued(JobSystem* system) {
+    for (int i = 0; i <= JOB_MAX_WORKERS; ++i) {
+        JobDeque* deque = &system->deques[i];
+        SDL_AtomicLock(&deque->lock);
+        bool queued = deque->bottom > deque->top;
+        SDL_AtomicUnlock(&deque->lock);
+        if (queued) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Takes one sleeping worker off the count. Returns false if there was none.
+inline bool jobClaimSleeper(JobSystem* system) {
+    // An atomic add rather than a plain load, so the read cannot be
+    // reordered before the push the caller just made
+    int sleeping = SDL_AtomicAdd(&system->sleeping, 0);
+    while (sleeping > 0) {
+        if (SDL_AtomicCAS(&system->sleeping, sleeping, sleeping - 1)) {
+            return true;
+        }
+        sleeping = SDL_AtomicGet(&system->sleeping);
+    }
+    return false;
+}
+
+// Runs one job: the calling worker's newest, otherwise the oldest job of
+// anyone else. Returns false if every deque is empty.
+inline bool jobTryRun(JobSystem* system) {
+    if (system == NULL) {
+        return false;
+    }
+    int index = *jobThreadIndex();
+    int own = index >= 0 ? index : JOB_SHARED;
+    Job job;
+    bool found = jobDequePop(&system->deques[own], &job);
+    bool stolen = false;
+    if (!found && own != JOB_SHARED) {
+        found = stolen = jobDequeSteal(&system->deques[JOB_SHARED], &job);
+    }
+    // Try the other workers in turn, starting after this one
+    for (int i = 1; !found && i <= system->numWorkers; ++i) {
+        int victim = (index + i) % system->numWorkers;
+        if (victim != own) {
+            found = stolen = jobDequeSteal(&system->deques[victim], &job);
+        }
+    }
+    if (!found) {
+        return false;
+    }
+    if (index >= 0) {
+        system->workers[index].executed++;
+        system->workers[index].stolen += stolen;
+    }
+    jobRun(system, &job);
+    return true;
+}
+
+// Queues function(data, begin, end). If counter is not NULL it is counted up
+// now and down when the job finishes.
+inline void jobSubmit(JobSystem* system, JobFunction function, void* data, int begin, int end, JobCounter* counter, JobCounter* dependency) {
+    Job job = {function, data, begin, end, counter, dependency};
+    if (counter != NULL) {
+        SDL_AtomicAdd(&counter->pending, 1);
+    }
+    if (system == NULL || system->numWorkers == 0 || !jobDequePush(jobOwnDeque(system), &job)) {
+        // No pool or a full deque: run it here and now
+        jobRun(system, &job);
+        return;
+    }
+    if (jobClaimSleeper(system)) {
+        SDL_SemPost(system->wake);
+    }
+}
+
+// Splits [0, count) into jobs of at most grain items each. Small ranges run
+// on the calling thread straight away. Wait on counter for completion.
+inline void jobParallelFor(JobSystem* system, JobFunction function, void* data, int count, int grain, JobCounter* counter) {
+    if (system == NULL || count <= grain) {
+        function(data, 0, count);
+        return;
+    }
+    for (int begin = 0; begin < count; begin += grain) {
+        int end = begin + grain < count ? begin + grain : count;
+        jobSubmit(system, function, data, begin, end, counter, NULL);
+    }
+}
+
+inline int jobWorkerThread(void* data) {
+    JobWorker* worker = (JobWorker*)data;
+    JobSystem* system = worker->system;
+    *jobThreadIndex() = worker->index;
+    while (!SDL_AtomicGet(&system->quit)) {
+        if (jobTryRun(system)) {
+            continue;
+        }
+        // Count ourselves asleep before the last look at the deques, so a job
+        // pushed meanwhile is either seen here or finds us counted and posts
+        SDL_AtomicAdd(&system->sleeping, 1);
+        if (jobAnyQueued(system) && jobClaimSleeper(system)) {
+            continue;
+        }
+        // Otherwise a post is on its way, or will be with the next job
+        SDL_SemWait(system->wake);
+    }
+    return 0;
+}
+
+inline bool jobSystemInit(JobSystem* system, int numWorkers) {
+    memset(system, 0, sizeof(*system));
+    if (numWorkers > JOB_MAX_WORKERS) {
+        numWorkers = JOB_MAX_WORKERS;
+    }
+    system->wake = SDL_CreateSemaphore(0);
+    if (system->wake == NULL) {
+        std::cout << "Job Semaphore Error: " << SDL_GetError() << std::endl;
+        return false;
+    }
+
+    for (int i = 0; i < numWorkers; ++i) {
+        JobWorker* worker = &system->workers[i];
+        worker->system = system;
+        worker->index = i;
+        char name[16];
+        snprintf(name, sizeof(name), "job%d", i);
+        worker->thread = SDL_CreateThread(jobWorkerThread, name, worker);
+        if (worker->thread == NULL) {
+            // Run with the workers that did start
+            std::cout << "Job Thread Error: " << SDL_GetError() << std::endl;
+            break;
+        }
+        system->numWorkers++;
+    }
+    return true;
+}
+
+inline void jobSystemPrintStats(const JobSystem* system) {
+    std::cout << "Jobs: " << system->numWorkers << " workers, executed/stolen";
+    for (int i = 0; i < system->numWorkers; ++i) {
+        std::cout << " " << system->workers[i].executed << "/" << system->workers[i].stolen;
+    }
+    std::cout << std::endl;
+}
+
+// Finishes queued jobs, then stops the workers.
+inline void jobSystemDestroy(JobSystem* system) {
+    while (jobTryRun(system)) {
+    }
+    SDL_AtomicSet(&system->quit, 1);
+    for (int i = 0; i < system->numWorkers; ++i) {
+        SDL_SemPost(system->wake);
+    }
+    for (int i = 0; i < system->numWorkers; ++i) {
+        SDL_WaitThread(system->workers[i].thread, NULL);
+    }
+    if (system->wake != NULL) {
+        SDL_DestroySemaphore(system->wake);
+        system->wake = NULL;
+    }
+    system->numWorkers = 0;
+}
+
+#endif
@@ -0,0 +1,353 @@
+#ifndef NETPLAY_H
+#define NETPLAY_H
+
+// Rollback netcode for two-player versus races over UDP.
+//
+// Each peer simulates every frame immediately using its own input and a
+// prediction of the remote input. When the real remote input arrives and
+// differs from the prediction, the game state is restored from the snapshot
+// ring and the affected frames are simulated again. Nothing is simulated
+// until the peers have heard each other: both send hello packets until one
+// arrives from the other side saying it has heard them too.
+
+#include <SDL2/SDL.h>
+#include <iostream>
+#include <errno.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#define NETPLAY_MAX_ROLLBACK 8      // frames we may run ahead of the remote
+#define NETPLAY_SNAPSHOTS (NETPLAY_MAX_ROLLBACK + 2)
+#define NETPLAY_INPUT_RING 64       // must cover every unacknowledged local input
+#define NETPLAY_MAGIC 0x44494E4Fu   // "DINO"
+#define NETPLAY_HELLO 0x48454C4Fu   // "HELO"
+#define NETPLAY_PACKET_SIZE (13 + NETPLAY_INPUT_RING)
+#define NETPLAY_FRAME_BUDGET_MS (1000.0 / 60.0)
+
+// Simulates one frame and returns the events it raised, as caller-defined bits.
+typedef int (*NetplayAdvanceFn)(void* state, const Uint8* inputs);
+
+typedef struct {
+    int fd;
+    struct sockaddr_in remote;
+} UdpSocket;
+
+typedef struct {
+    int rollbacks;          // number of times a misprediction forced a rollback
+    int lastRollbackDepth;  // frames re-simulated by the most recent rollback
+    int maxRollbackDepth;
+    double lastResimMs;     // time spent re-simulating in the most recent rollback
+    double maxResimMs;
+    double totalResimMs;
+    int overBudget;         // rollbacks that did not fit in one frame
+    int stalls;             // frames skipped waiting for the remote peer
+    int correctedEvents;    // events that only happened once a rollback corrected a frame
+} NetplayStats;
+
+typedef struct {
+    UdpSocket socket;
+    bool heardRemote;       // a hello or input packet has arrived from the remote
+    bool connected;         // the remote has heard us too; frames may be simulated
+    int localPlayer;        // index of the local dino in the inputs array (0 or 1)
+    int frame;              // next frame to be simulated
+    int remoteFrame;        // last frame with confirmed remote input, -1 for none
+    int remoteAck;          // last local frame the remote has confirmed, -1 for none
+    int rollbackFrame;      // earliest mispredicted frame, -1 when predictions held
+    Uint8 localInputs[NETPLAY_INPUT_RING];
+    Uint8 remoteInputs[NETPLAY_INPUT_RING];  // confirmed up to remoteFrame, predicted after
+    int frameEvents[NETPLAY_INPUT_RING];     // events each frame raised when last simulated
+    int events;                              // events not yet handed to the caller
+    void* state;
+    size_t stateSize;
+    unsigned char* snapshots;                // NETPLAY_SNAPSHOTS copies of the state
+    NetplayAdvanceFn advance;
+    NetplayStats stats;
+} NetplaySession;
+
+inline bool udpOpen(UdpSocket* sock, int localPort, const char* remoteHost, int remotePort) {
+    sock->fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (sock->fd < 0) {
+        std::cout << "UDP Socket Error: " << strerror(errno) << std::endl;
+        return false;
+    }
+
+    struct sockaddr_in local;
+    memset(&local, 0, sizeof(local));
+    local.sin_family = AF_INET;
+    local.sin_addr.s_addr = htonl(INADDR_ANY);
+    local.sin_port = htons(localPort);
+    if (bind(sock->fd, (struct sockaddr*)&local, sizeof(local)) != 0) {
+        std::cout << "UDP Bind Error: " << strerror(errno) << std::endl;
+        close(sock->fd);
+        return false;
+    }
+
+    struct addrinfo hints;
+    struct addrinfo* result = NULL;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_DGRAM;
+    if (getaddrinfo(remoteHost, NULL, &hints, &result) != 0 || result == NULL) {
+        std::cout << "UDP Resolve Error: " << remoteHost << std::endl;
+        close(sock->fd);
+        return false;
+    }
+    memcpy(&sock->remote, result->ai_addr, sizeof(sock->remote));
+    sock->remote.sin_port = htons(remotePort);
+    freeaddrinfo(result);
+
+    fcntl(sock->fd, F_SETFL, fcntl(sock->fd, F_GETFL, 0) | O_NONBLOCK);
+    return true;
+}
+
+inline void udpClose(UdpSocket* sock) {
+    if (sock->fd >= 0) {
+        close(sock->fd);
+        sock->fd = -1;
+    }
+}
+
+inline void netplayWrite32(unsigned char* buffer, Uint32 value) {
+    value = htonl(value);
+    memcpy(buffer, &value, 4);
+}
+
+inline Uint32 netplayRead32(const unsigned char* buffer) {
+    Uint32 value;
+    memcpy(&value, buffer, 4);
+    return ntohl(value);
+}
+
+// The remote is predicted to keep holding its last confirmed direction.
+// Jumps are key presses rather than held keys, so they are never repeated.
+inline Uint8 netplayPredict(NetplaySession* session) {
+    if (session->remoteFrame < 0) {
+        return 0;
+    }
+    return session->remoteInputs[session->remoteFrame % NETPLAY_INPUT_RING] & ~0x01;
+}
+
+inline void netplaySaveSnapshot(NetplaySession* session, int frame) {
+    memcpy(session->snapshots + (frame % NETPLAY_SNAPSHOTS) * session->stateSize, session->state, session->stateSize);
+}
+
+inline void netplayLoadSnapshot(NetplaySession* session, int frame) {
+    memcpy(session->state, session->snapshots + (frame % NETPLAY_SNAPSHOTS) * session->stateSize, session->stateSize);
+}
+
+// Returns the events the frame raised.
+inline int netplaySimulate(NetplaySession* session, int frame) {
+    Uint8 inputs[2];
+    inputs[session->localPlayer] = session->localInputs[frame % NETPLAY_INPUT_RING];
+    inputs[1 - session->localPlayer] = session->remoteInputs[frame % NETPLAY_INPUT_RING];
+    return session->advance(session->state, inputs);
+}
+
+inline bool netplayOpen(NetplaySession* session, int localPlayer, int localPort, const char* remoteHost, int remotePort,
+                        void* state, size_t stateSize, NetplayAdvanceFn advance) {
+    memset(session, 0, sizeof(*session));
+    session->localPlayer = localPlayer;
+    session->remoteFrame = -1;
+    session->remoteAck = -1;
+    session->rollbackFrame = -1;
+    session->state = state;
+    session->stateSize = stateSize;
+    session->advance = advance;
+
+    session->snapshots = (unsigned char*)malloc(NETPLAY_SNAPSHOTS * stateSize);
+    if (session->snapshots == NULL) {
+        std::cout << "Netplay Error: out of memory" << std::endl;
+        return false;
+    }
+
+    if (!udpOpen(&session->socket, localPort, remoteHost, remotePort)) {
+        free(session->snapshots);
+        session->snapshots = NULL;
+        return false;
+    }
+    return true;
+}
+
+inline void netplayClose(NetplaySession* session) {
+    udpClose(&session->socket);
+    free(session->snapshots);
+    session->snapshots = NULL;
+}
+
+// Hello layout: NETPLAY_HELLO (32-bit big endian), then 1 if we have heard
+// the remote, else 0.
+inline void netplaySendHello(NetplaySession* session) {
+    unsigned char packet[5];
+    netplayWrite32(packet, NETPLAY_HELLO);
+    packet[4] = session->heardRemote ? 1 : 0;
+    sendto(session->socket.fd, packet, sizeof(packet), 0, (struct sockaddr*)&session->socket.remote, sizeof(session->socket.remote));
+}
+
+// Packet layout: magic, ack frame, first input frame (all 32-bit big endian),
+// input count, then one input byte per frame.
+inline void netplaySend(NetplaySession* session) {
+    unsigned char packet[NETPLAY_PACKET_SIZE];
+    int first = session->remoteAck + 1;
+    int count = session->frame - first;
+    if (count > NETPLAY_INPUT_RING) {
+        count = NETPLAY_INPUT_RING;
+    }
+
+    netplayWrite32(packet, NETPLAY_MAGIC);
+    netplayWrite32(packet + 4, (Uint32)session->remoteFrame);
+    netplayWrite32(packet + 8, (Uint32)first);
+    packet[12] = (Uint8)count;
+    for (int i = 0; i < count; ++i) {
+        packet[13 + i] = session->localInputs[(first + i) % NETPLAY_INPUT_RING];
+    }
+
+    sendto(session->socket.fd, packet, 13 + count, 0, (struct sockaddr*)&session->socket.remote, sizeof(session->socket.remote));
+}
+
+inline void netplayReceive(NetplaySession* session) {
+    unsigned char packet[NETPLAY_PACKET_SIZE];
+    ssize_t length;
+    while ((length = recv(session->socket.fd, packet, sizeof(packet), 0)) >= 0) {
+        if (length >= 5 && netplayRead32(packet) == NETPLAY_HELLO) {
+            session->heardRemote = true;
+            if (packet[4]) {
+                session->connected = true;
+            }
+            continue;
+        }
+        if (length < 13 || netplayRead32(packet) != NETPLAY_MAGIC || length < 13 + packet[12]) {
+            continue;
+        }
+        // Input only flows once the remote has finished its handshake
+        session->heardRemote = true;
+        session->connected = true;
+
+        int ack = (int)netplayRead32(packet + 4);
+        if (ack > session->remoteAck) {
+            session->remoteAck = ack;
+        }
+
+        int first = (int)netplayRead32(packet + 8);
+        int count = packet[12];
+        for (int i = 0; i < count; ++i) {
+            int frame = first + i;
+            if (frame != session->remoteFrame + 1) {
+                continue;  // already confirmed, or a gap that a later packet will fill
+            }
+
+            Uint8 input = packet[13 + i];
+            Uint8* slot = &session->remoteInputs[frame % NETPLAY_INPUT_RING];
+            if (frame < session->frame && *slot != input &&
+                (session->rollbackFrame < 0 || frame < session->rollbackFrame)) {
+                session->rollbackFrame = frame;
+            }
+            *slot = input;
+            session->remoteFrame = frame;
+        }
+    }
+}
+
+inline void netplayRollback(NetplaySession* session) {
+    int start = session->rollbackFrame;
+    session->rollbackFrame = -1;
+
+    Uint64 begin = SDL_GetPerformanceCounter();
+
+    // Frames past the confirmed input are re-predicted from the newest confirmed input.
+    Uint8 prediction = netplayPredict(session);
+    for (int frame = session->remoteFrame + 1; frame < session->frame; ++frame) {
+        session->remoteInputs[frame % NETPLAY_INPUT_RING] = prediction;
+    }
+
+    // Events a corrected frame raises that its first run did not are passed
+    // on late; ones that no longer happen cannot be taken back
+    netplayLoadSnapshot(session, start);
+    for (int frame = start; frame < session->frame; ++frame) {
+        netplaySaveSnapshot(session, frame);
+        int events = netplaySimulate(session, frame);
+        int* previous = &session->frameEvents[frame % NETPLAY_INPUT_RING];
+        if (events & ~*previous) {
+            session->events |= events & ~*previous;
+            session->stats.correctedEvents++;
+        }
+        *previous = events;
+    }
+
+    double elapsed = (double)(SDL_GetPerformanceCounter() - begin) * 1000.0 / SDL_GetPerformanceFrequency();
+    NetplayStats* stats = &session->stats;
+    stats->rollbacks++;
+    stats->lastRollbackDepth = session->frame - start;
+    if (stats->lastRollbackDepth > stats->maxRollbackDepth) {
+        stats->maxRollbackDepth = stats->lastRollbackDepth;
+    }
+    stats->lastResimMs = elapsed;
+    if (elapsed > stats->maxResimMs) {
+        stats->maxResimMs = elapsed;
+    }
+    stats->totalResimMs += elapsed;
+    if (elapsed > NETPLAY_FRAME_BUDGET_MS) {
+        stats->overBudget++;
+    }
+}
+
+// Runs one frame of the session with this frame's local input. Returns false,
+// leaving the input unused, while the handshake is in progress or when the
+// local peer is too far ahead of the remote and has to wait. Either way
+// events gets the events raised by this frame and by any frame a rollback
+// corrected.
+inline bool netplayAdvance(NetplaySession* session, Uint8 localInput, int* events) {
+    netplayReceive(session);
+    *events = 0;
+
+    if (!session->connected) {
+        session->stats.stalls++;
+        netplaySendHello(session);
+        return false;
+    }
+
+    if (session->rollbackFrame >= 0) {
+        netplayRollback(session);
+    }
+    *events = session->events;
+    session->events = 0;
+
+    if (session->frame - session->remoteFrame > NETPLAY_MAX_ROLLBACK ||
+        session->frame - session->remoteAck >= NETPLAY_INPUT_RING) {
+        session->stats.stalls++;
+        netplaySend(session);
+        return false;
+    }
+
+    int frame = session->frame;
+    session->localInputs[frame % NETPLAY_INPUT_RING] = localInput;
+    if (frame > session->remoteFrame) {
+        session->remoteInputs[frame % NETPLAY_INPUT_RING] = netplayPredict(session);
+    }
+
+    netplaySaveSnapshot(session, frame);
+    session->frameEvents[frame % NETPLAY_INPUT_RING] = netplaySimulate(session, frame);
+    *events |= session->frameEvents[frame % NETPLAY_INPUT_RING];
+    session->frame++;
+
+    netplaySend(session);
+    return true;
+}
+
+inline void netplayPrintStats(const NetplaySession* session) {
+    const NetplayStats* stats = &session->stats;
+    std::cout << "Netplay: " << session->frame << " frames, "
+              << stats->rollbacks << " rollbacks (max depth " << stats->maxRollbackDepth << "), "
+              << "resim avg " << (stats->rollbacks ? stats->totalResimMs / stats->rollbacks : 0.0) << " ms, "
+              << "max " << stats->maxResimMs << " ms, "
+              << stats->overBudget << " over budget, "
+              << stats->stalls << " stalls, "
+              << stats->correctedEvents << " late events" << std::endl;
+}
+
+#endif
@@ -0,0 +1,215 @@
+#ifndef QUALITY_H
+#define QUALITY_H
+
+// Resolution-independent rendering and an adaptive quality governor.
+//
+// The game draws in fixed logical coordinates into a scene texture whose pixel
+// size is the letterboxed on-screen area times the current render scale, and
+// the scene is then stretched onto the window. The governor watches the work
+// done each frame and steps down through QUALITY_LEVELS (lower internal
+// resolution, sparser grass, fewer stones and clouds) while the 95th
+// percentile misses the budget, and steps back up once there is clear
+// headroom again. Work time stops where present starts, so waiting for vsync
+// on a display slower than the budget never counts as a missed frame.
+
+#include <SDL2/SDL.h>
+#include <iostream>
+#include <stdlib.h>
+#include <string.h>
+
+#define QUALITY_SAMPLES 120          // frames in the percentile window
+#define QUALITY_EVALUATE_EVERY 60    // frames between decisions
+#define QUALITY_OVER_BUDGET 1.1      // p95 work time above budget * this lowers quality
+#define QUALITY_HEADROOM 0.5         // p95 work time below budget * this counts as headroom
+#define QUALITY_RESTORE_WINDOWS 3    // consecutive windows of headroom before raising quality
+
+typedef struct {
+    float renderScale;   // internal resolution relative to the on-screen size
+    int grassSpacing;    // pixels between grass blades
+    int numStones;
+    int numClouds;
+} QualityLevel;
+
+static const QualityLevel QUALITY_LEVELS[] = {
+    {1.0f, 10, 20, 3},
+    {0.75f, 10, 20, 3},
+    {0.75f, 20, 10, 2},
+    {0.5f, 20, 10, 2},
+    {0.5f, 40, 0, 1},
+    {0.35f, 40, 0, 1},
+};
+#define NUM_QUALITY_LEVELS ((int)(sizeof(QUALITY_LEVELS) / sizeof(QUALITY_LEVELS[0])))
+
+typedef struct {
+    double budgetMs;
+    float maxRenderScale;        // configured internal resolution at the top level
+    int level;                   // index into QUALITY_LEVELS, 0 is best
+    double frameMs[QUALITY_SAMPLES];  // whole frame, including any wait in present
+    double workMs[QUALITY_SAMPLES];   // frame start until present is called
+    int count;
+    int next;
+    int sinceEvaluation;
+    int headroomWindows;
+    double p95FrameMs;
+    double p95WorkMs;
+    int downgrades;
+    int upgrades;
+} QualityGovernor;
+
+typedef struct {
+    int logicalWidth;
+    int logicalHeight;
+    SDL_Texture* texture;        // NULL while drawing straight to the window
+    int width;
+    int height;
+    bool unsupported;            // the renderer cannot render to textures
+} Scene;
+
+inline void qualityInit(QualityGovernor* governor, double budgetMs, float maxRenderScale) {
+    memset(governor, 0, sizeof(*governor));
+    governor->budgetMs = budgetMs;
+    governor->maxRenderScale = maxRenderScale;
+}
+
+inline const QualityLevel* qualityCurrent(const QualityGovernor* governor) {
+    return &QUALITY_LEVELS[governor->level];
+}
+
+inline float qualityRenderScale(const QualityGovernor* governor) {
+    return QUALITY_LEVELS[governor->level].renderScale * governor->maxRenderScale;
+}
+
+inline int qualityCompare(const void* a, const void* b) {
+    double x = *(const double*)a;
+    double y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+inline double qualityPercentile95(const double* samples, int count) {
+    double sorted[QUALITY_SAMPLES];
+    memcpy(sorted, samples, count * sizeof(double));
+    qsort(sorted, count, sizeof(double), qualityCompare);
+    return sorted[(count * 95) / 100];
+}
+
+// Records one frame. Returns true when the quality level changed.
+inline bool qualityRecord(QualityGovernor* governor, double frameMs, double workMs) {
+    governor->frameMs[governor->next] = frameMs;
+    governor->workMs[governor->next] = workMs;
+    governor->next = (governor->next + 1) % QUALITY_SAMPLES;
+    if (governor->count < QUALITY_SAMPLES) {
+        governor->count++;
+    }
+
+    if (++governor->sinceEvaluation < QUALITY_EVALUATE_EVERY || governor->count < QUALITY_SAMPLES / 2) {
+        return false;
+    }
+    governor->sinceEvaluation = 0;
+    governor->p95FrameMs = qualityPercentile95(governor->frameMs, governor->count);
+    governor->p95WorkMs = qualityPercentile95(governor->workMs, governor->count);
+
+    int level = governor->level;
+    if (governor->p95WorkMs > governor->budgetMs * QUALITY_OVER_BUDGET) {
+        governor->headroomWindows = 0;
+        if (level + 1 < NUM_QUALITY_LEVELS) {
+            level++;
+            governor->downgrades++;
+        }
+    } else if (governor->p95WorkMs < governor->budgetMs * QUALITY_HEADROOM) {
+        if (level > 0 && ++governor->headroomWindows >= QUALITY_RESTORE_WINDOWS) {
+            governor->headroomWindows = 0;
+            level--;
+            governor->upgrades++;
+        }
+    } else {
+        governor->headroomWindows = 0;
+    }
+
+    if (level == governor->level) {
+        return false;
+    }
+    // Judge the new level on its own frames only
+    governor->level = level;
+    governor->count = 0;
+    governor->next = 0;
+    return true;
+}
+
+inline void qualityPrintStats(const QualityGovernor* governor) {
+    std::cout << "Quality: level " << governor->level << " of " << NUM_QUALITY_LEVELS - 1
+              << ", render scale " << qualityRenderScale(governor) << ", "
+              << governor->downgrades << " downgrades, " << governor->upgrades << " upgrades, "
+              << "last p95 frame " << governor->p95FrameMs << " ms, work " << governor->p95WorkMs << " ms"
+              << " of " << governor->budgetMs << " ms budget" << std::endl;
+}
+
+inline void sceneInit(Scene* scene, int logicalWidth, int logicalHeight) {
+    memset(scene, 0, sizeof(*scene));
+    scene->logicalWidth = logicalWidth;
+    scene->logicalHeight = logicalHeight;
+}
+
+// Size in pixels of the letterboxed area the logical screen covers.
+inline void sceneViewportSize(SDL_Renderer* renderer, const Scene* scene, int* width, int* height) {
+    int outputWidth, outputHeight;
+    SDL_GetRendererOutputSize(renderer, &outputWidth, &outputHeight);
+    if (outputWidth * scene->logicalHeight > outputHeight * scene->logicalWidth) {
+        *height = outputHeight;
+        *width = outputHeight * scene->logicalWidth / scene->logicalHeight;
+    } else {
+        *width = outputWidth;
+        *height = outputWidth * scene->logicalHeight / scene->logicalWidth;
+    }
+}
+
+// Points drawing at the scene texture, resized to match the window and render
+// scale. Falls back to drawing at window resolution if render targets fail.
+inline void sceneBegin(SDL_Renderer* renderer, Scene* scene, float renderScale) {
+    if (scene->unsupported) {
+        return;
+    }
+
+    int width, height;
+    sceneViewportSize(renderer, scene, &width, &height);
+    width = (int)(width * renderScale);
+    height = (int)(height * renderScale);
+    if (width < 1) width = 1;
+    if (height < 1) height = 1;
+
+    if (scene->texture == NULL || scene->width != width || scene->height != height) {
+        if (scene->texture != NULL) {
+            SDL_DestroyTexture(scene->texture);
+        }
+        scene->texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_TARGET, width, height);
+        if (scene->texture == NULL) {
+            std::cout << "Scene Texture Error: " << SDL_GetError() << std::endl;
+            scene->unsupported = true;
+            return;
+        }
+        scene->width = width;
+        scene->height = height;
+    }
+
+    SDL_SetRenderTarget(renderer, scene->texture);
+    SDL_RenderSetScale(renderer, (float)width / scene->logicalWidth, (float)height / scene->logicalHeight);
+}
+
+// Stretches the scene onto the window and presents it.
+inline void scenePresent(SDL_Renderer* renderer, Scene* scene) {
+    if (scene->texture != NULL && !scene->unsupported) {
+        SDL_SetRenderTarget(renderer, NULL);
+        SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
+        SDL_RenderClear(renderer);
+        SDL_RenderCopy(renderer, scene->texture, NULL, NULL);
+    }
+    SDL_RenderPresent(renderer);
+}
+
+inline void sceneDestroy(Scene* scene) {
+    if (scene->texture != NULL) {
+        SDL_DestroyTexture(scene->texture);
+        scene->texture = NULL;
+    }
+}
+
+#endif
@@ -0,0 +1,210 @@
+#ifndef RENDERQUEUE_H
+#define RENDERQUEUE_H
+
+// Sorted, batched 2D drawing.
+//
+// Game code submits textured sprites and solid rectangles with a layer and a
+// depth instead of drawing them on the spot. Flushing sorts everything by
+// layer, then texture, then blend mode, then depth, and draws each run that
+// shares a texture and blend mode with a single SDL_RenderGeometry call.
+// Layers are drawn strictly in order, so anything that has to appear on top
+// of something else belongs in a higher layer; depth only orders items that
+// land in the same batch.
+
+#include <SDL2/SDL.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+    int layer;
+    int depth;
+    int sequence;           // submission order, keeps the sort stable
+    SDL_Texture* texture;   // NULL for a solid rectangle
+    SDL_BlendMode blend;
+    SDL_Rect rect;
+    SDL_Color color;        // fill colour, or tint for a sprite
+} RenderItem;
+
+typedef struct {
+    int items;              // sprites and rectangles submitted
+    int drawCalls;
+    int stateChanges;       // texture or blend mode switches between batches
+    int vertices;
+} RenderStats;
+
+typedef struct {
+    RenderItem* items;
+    int count;
+    int capacity;
+    SDL_Vertex* vertices;
+    int* indices;
+    int vertexCapacity;     // quads' worth of vertices and indices
+    RenderStats stats;      // of the last flush
+} RenderQueue;
+
+inline void renderQueueInit(RenderQueue* queue) {
+    memset(queue, 0, sizeof(*queue));
+}
+
+inline RenderItem* renderQueuePush(RenderQueue* queue) {
+    if (queue->count == queue->capacity) {
+        int capacity = queue->capacity ? queue->capacity * 2 : 256;
+        RenderItem* items = (RenderItem*)realloc(queue->items, capacity * sizeof(RenderItem));
+        if (items == NULL) {
+            return NULL;
+        }
+        queue->items = items;
+        queue->capacity = capacity;
+    }
+    RenderItem* item = &queue->items[queue->count];
+    item->sequence = queue->count++;
+    return item;
+}
+
+inline void renderQueueRect(RenderQueue* queue, int layer, int depth, const SDL_Rect* rect, SDL_Color color) {
+    RenderItem* item = renderQueuePush(queue);
+    if (item == NULL) {
+        return;
+    }
+    item->layer = layer;
+    item->depth = depth;
+    item->texture = NULL;
+    item->blend = color.a == 255 ? SDL_BLENDMODE_NONE : SDL_BLENDMODE_BLEND;
+    item->rect = *rect;
+    item->color = color;
+}
+
+// Draws the whole texture stretched over rect, multiplied by tint.
+inline void renderQueueSprite(RenderQueue* queue, int layer, int depth, SDL_Texture* texture, const SDL_Rect* rect, SDL_Color tint) {
+    if (texture == NULL) {
+        return;
+    }
+    RenderItem* item = renderQueuePush(queue);
+    if (item == NULL) {
+        return;
+    }
+    item->layer = layer;
+    item->depth = depth;
+    item->texture = texture;
+    SDL_GetTextureBlendMode(texture, &item->blend);
+    item->rect = *rect;
+    item->color = tint;
+}
+
+inline int renderItemCompare(const void* a, const void* b) {
+    const RenderItem* x = (const RenderItem*)a;
+    const RenderItem* y = (const RenderItem*)b;
+    if (x->layer != y->layer) {
+        return x->layer < y->layer ? -1 : 1;
+    }
+    if (x->texture != y->texture) {
+        return (uintptr_t)x->texture < (uintptr_t)y->texture ? -1 : 1;
+    }
+    if (x->blend != y->blend) {
+        return x->blend < y->blend ? -1 : 1;
+    }
+    if (x->depth != y->depth) {
+        return x->depth < y->depth ? -1 : 1;
+    }
+    return x->sequence - y->sequence;
+}
+
+inline bool renderQueueReserve(RenderQueue* queue, int quads) {
+    if (quads <= queue->vertexCapacity) {
+        return true;
+    }
+    SDL_Vertex* vertices = (SDL_Vertex*)realloc(queue->vertices, quads * 4 * sizeof(SDL_Vertex));
+    if (vertices == NULL) {
+        return false;
+    }
+    queue->vertices = vertices;
+    int* indices = (int*)realloc(queue->indices, quads * 6 * sizeof(int));
+    if (indices == NULL) {
+        return false;
+    }
+    queue->indices = indices;
+    queue->vertexCapacity = quads;
+    return true;
+}
+
+// Draws everything submitted since the last flush and empties the queue.
+inline void renderQueueFlush(RenderQueue* queue, SDL_Renderer* renderer) {
+    memset(&queue->stats, 0, sizeof(queue->stats));
+    queue->stats.items = queue->count;
+    qsort(queue->items, queue->count, sizeof(RenderItem), renderItemCompare);
+
+    SDL_Texture* currentTexture = NULL;
+    SDL_BlendMode currentBlend = SDL_BLENDMODE_NONE;
+    SDL_BlendMode drawBlend = SDL_BLENDMODE_NONE;
+    SDL_SetRenderDrawBlendMode(renderer, drawBlend);
+
+    int start = 0;
+    while (start < queue->count) {
+        // A batch runs while the texture and blend mode stay the same
+        const RenderItem* first = &queue->items[start];
+        int end = start + 1;
+        while (end < queue->count && queue->items[end].layer == first->layer &&
+               queue->items[end].texture == first->texture && queue->items[end].blend == first->blend) {
+            end++;
+        }
+        int quads = end - start;
+        if (!renderQueueReserve(queue, quads)) {
+            break;
+        }
+
+        for (int i = 0; i < quads; ++i) {
+            const RenderItem* item = &queue->items[start + i];
+            float left = (float)item->rect.x;
+            float top = (float)item->rect.y;
+            float right = left + item->rect.w;
+            float bottom = top + item->rect.h;
+            SDL_Vertex* v = &queue->vertices[i * 4];
+            v[0] = {{left, top}, item->color, {0.0f, 0.0f}};
+            v[1] = {{right, top}, item->color, {1.0f, 0.0f}};
+            v[2] = {{right, bottom}, item->color, {1.0f, 1.0f}};
+            v[3] = {{left, bottom}, item->color, {0.0f, 1.0f}};
+            int* index = &queue->indices[i * 6];
+            index[0] = i * 4;
+            index[1] = i * 4 + 1;
+            index[2] = i * 4 + 2;
+            index[3] = i * 4;
+            index[4] = i * 4 + 2;
+            index[5] = i * 4 + 3;
+        }
+
+        if (start > 0 && (first->texture != currentTexture || first->blend != currentBlend)) {
+            queue->stats.stateChanges++;
+        }
+        // Sprites blend with their texture's mode; solid fills use the draw mode
+        if (first->texture == NULL && first->blend != drawBlend) {
+            drawBlend = first->blend;
+            SDL_SetRenderDrawBlendMode(renderer, drawBlend);
+        }
+        currentTexture = first->texture;
+        currentBlend = first->blend;
+
+        SDL_RenderGeometry(renderer, first->texture, queue->vertices, quads * 4, queue->indices, quads * 6);
+        queue->stats.drawCalls++;
+        queue->stats.vertices += quads * 4;
+        start = end;
+    }
+
+    SDL_SetRenderDrawBlendMode(renderer, SDL_BLENDMODE_NONE);
+    queue->count = 0;
+}
+
+// One line for the debug overlay.
+inline void renderQueueDescribe(const RenderQueue* queue, char* text, int size) {
+    snprintf(text, size, "Render: %d items, %d draw calls, %d state changes, %d vertices",
+             queue->stats.items, queue->stats.drawCalls, queue->stats.stateChanges, queue->stats.vertices);
+}
+
+inline void renderQueueDestroy(RenderQueue* queue) {
+    free(queue->items);
+    free(queue->vertices);
+    free(queue->indices);
+    memset(queue, 0, sizeof(*queue));
+}
+
+#endif
@@ -0,0 +1,499 @@
+#ifndef SPECTATOR_H
+#define SPECTATOR_H
+
+// Spectator broadcast: streams the game state to many local viewers.
+//
+// The game thread hands each step's state to spectatorPublish(), which only
+// copies it into a lock-free triple buffer and never waits on the server. A
+// server thread multiplexes the listening sockets and every subscriber with
+// epoll, encodes the newest state once as a delta against the previous
+// broadcast (or a keyframe for new viewers), and appends the bytes to each
+// subscriber's bounded send queue. Viewers that fall so far behind that their
+// queue fills up are disconnected instead of slowing anyone else down.
+//
+// Wire format: a stream of messages, each [type u8][payload length u8][payload].
+// A keyframe payload holds every field as a zigzag varint. A delta payload
+// holds a 32-bit big endian mask of the changed fields followed by the
+// zigzag varint difference of each changed field.
+
+#include <SDL2/SDL.h>
+#include "triplebuffer.h"
+#include <iostream>
+#include <errno.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#define SPECTATOR_MSG_KEYFRAME 1
+#define SPECTATOR_MSG_DELTA 2
+#define SPECTATOR_KEYFRAME_INTERVAL 300   // steps between periodic keyframes
+#define SPECTATOR_MAX_CLIENTS 1024
+#define SPECTATOR_QUEUE_BYTES 4096        // per-client backlog before the viewer is dropped
+#define SPECTATOR_MAX_MESSAGE (2 + 4 + SPECTATOR_FIELDS * 5)
+
+// Field layout of a published frame
+#define SPEC_NUM_PLAYERS 0
+#define SPEC_SCORE 1
+#define SPEC_GHOST 2           // x, y, w, h, active
+#define SPEC_DINO(i) (7 + (i) * 7)  // x, y, w, h, velocity_y, velocity_x, jumpCount
+#define SPEC_MAX_DINOS 2
+#define SPECTATOR_FIELDS SPEC_DINO(SPEC_MAX_DINOS)
+
+// epoll tags for the non-client descriptors
+#define SPECTATOR_TAG_WAKE SPECTATOR_MAX_CLIENTS
+#define SPECTATOR_TAG_TCP (SPECTATOR_MAX_CLIENTS + 1)
+#define SPECTATOR_TAG_UNIX (SPECTATOR_MAX_CLIENTS + 2)
+
+typedef struct {
+    Sint32 values[SPECTATOR_FIELDS];
+} SpectatorFrame;
+
+typedef struct {
+    int fd;
+    bool needsKeyframe;
+    bool wantsWrite;      // registered for EPOLLOUT because the queue did not drain
+    int head;             // ring buffer of bytes waiting to be sent
+    int size;
+    unsigned char queue[SPECTATOR_QUEUE_BYTES];
+} SpectatorClient;
+
+typedef struct {
+    int clients;          // currently connected viewers
+    int accepted;
+    int dropped;          // viewers disconnected for falling behind
+    long long bytesSent;
+    int broadcasts;
+    double maxPublishMs;  // worst time spent in spectatorPublish() on the game thread
+    double totalPublishMs;
+    int publishes;
+} SpectatorStats;
+
+typedef struct {
+    int epollFd;
+    int wakeFd;
+    int tcpFd;
+    int unixFd;
+    char unixPath[108];
+    SDL_Thread* thread;
+    SDL_atomic_t stopping;
+    SpectatorFrame slots[3];     // handed from the game thread to the server thread
+    TripleBuffer handoff;
+    SpectatorFrame last;         // base of the next delta
+    int sinceKeyframe;
+    SpectatorClient* clients[SPECTATOR_MAX_CLIENTS];
+    SpectatorStats stats;        // written by the server thread, except the publish timings
+} SpectatorServer;
+
+inline int spectatorPutVarint(unsigned char* out, Sint32 value) {
+    Uint32 zigzag = ((Uint32)value << 1) ^ (Uint32)(value >> 31);
+    int length = 0;
+    while (zigzag >= 0x80) {
+        out[length++] = (unsigned char)(zigzag | 0x80);
+        zigzag >>= 7;
+    }
+    out[length++] = (unsigned char)zigzag;
+    return length;
+}
+
+// Returns the number of bytes read, or 0 if the varint runs past the end.
+inline int spectatorGetVarint(const unsigned char* in, int available, Sint32* value) {
+    Uint32 zigzag = 0;
+    for (int i = 0; i < available && i < 5; ++i) {
+        zigzag |= (Uint32)(in[i] & 0x7F) << (7 * i);
+        if (!(in[i] & 0x80)) {
+            *value = (Sint32)((zigzag >> 1) ^ (~(zigzag & 1) + 1));
+            return i + 1;
+        }
+    }
+    return 0;
+}
+
+inline int spectatorEncodeKeyframe(const SpectatorFrame* frame, unsigned char* out) {
+    int length = 2;
+    for (int i = 0; i < SPECTATOR_FIELDS; ++i) {
+        length += spectatorPutVarint(out + length, frame->values[i]);
+    }
+    out[0] = SPECTATOR_MSG_KEYFRAME;
+    out[1] = (unsigned char)(length - 2);
+    return length;
+}
+
+inline int spectatorEncodeDelta(const SpectatorFrame* base, const SpectatorFrame* frame, unsigned char* out) {
+    Uint32 mask = 0;
+    int length = 6;
+    for (int i = 0; i < SPECTATOR_FIELDS; ++i) {
+        if (frame->values[i] != base->values[i]) {
+            mask |= 1u << i;
+            length += spectatorPutVarint(out + length, frame->values[i] - base->values[i]);
+        }
+    }
+    out[0] = SPECTATOR_MSG_DELTA;
+    out[1] = (unsigned char)(length - 2);
+    out[2] = (unsigned char)(mask >> 24);
+    out[3] = (unsigned char)(mask >> 16);
+    out[4] = (unsigned char)(mask >> 8);
+    out[5] = (unsigned char)mask;
+    return length;
+}
+
+// Applies one message from the front of the buffer to the frame. Returns the
+// number of bytes consumed, 0 if the message is not complete yet, or -1 if
+// the stream is corrupt.
+inline int spectatorDecode(const unsigned char* in, int available, SpectatorFrame* frame) {
+    if (available < 2 || available < 2 + in[1]) {
+        return 0;
+    }
+    const unsigned char* payload = in + 2;
+    int length = in[1];
+    int offset = 0;
+
+    if (in[0] == SPECTATOR_MSG_KEYFRAME) {
+        for (int i = 0; i < SPECTATOR_FIELDS; ++i) {
+            int used = spectatorGetVarint(payload + offset, length - offset, &frame->values[i]);
+            if (used == 0) {
+                return -1;
+            }
+            offset += used;
+        }
+    } else if (in[0] == SPECTATOR_MSG_DELTA && length >= 4) {
+        Uint32 mask = ((Uint32)payload[0] << 24) | ((Uint32)payload[1] << 16) | ((Uint32)payload[2] << 8) | payload[3];
+        offset = 4;
+        for (int i = 0; i < SPECTATOR_FIELDS; ++i) {
+            if (mask & (1u << i)) {
+                Sint32 delta;
+                int used = spectatorGetVarint(payload + offset, length - offset, &delta);
+                if (used == 0) {
+                    return -1;
+                }
+                frame->values[i] += delta;
+                offset += used;
+            }
+        }
+    } else {
+        return -1;
+    }
+    return 2 + length;
+}
+
+inline void spectatorCloseClient(SpectatorServer* server, int index) {
+    SpectatorClient* client = server->clients[index];
+    epoll_ctl(server->epollFd, EPOLL_CTL_DEL, client->fd, NULL);
+    close(client->fd);
+    free(client);
+    server->clients[index] = NULL;
+    server->stats.clients--;
+}
+
+// Sends as much of the queue as the socket takes without blocking, and keeps
+// EPOLLOUT registered only while bytes are left over.
+inline bool spectatorFlush(SpectatorServer* server, int index) {
+    SpectatorClient* client = server->clients[index];
+    while (client->size > 0) {
+        int chunk = client->size;
+        if (client->head + chunk > SPECTATOR_QUEUE_BYTES) {
+            chunk = SPECTATOR_QUEUE_BYTES - client->head;
+        }
+        ssize_t sent = send(client->fd, client->queue + client->head, chunk, MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (sent < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                break;
+            }
+            if (errno == EINTR) {
+                continue;
+            }
+            spectatorCloseClient(server, index);
+            return false;
+        }
+        client->head = (client->head + sent) % SPECTATOR_QUEUE_BYTES;
+        client->size -= sent;
+        server->stats.bytesSent += sent;
+    }
+
+    bool wantsWrite = client->size > 0;
+    if (wantsWrite != client->wantsWrite) {
+        struct epoll_event event;
+        event.events = EPOLLIN | EPOLLRDHUP | (wantsWrite ? (Uint32)EPOLLOUT : 0u);
+        event.data.u64 = index;
+        epoll_ctl(server->epollFd, EPOLL_CTL_MOD, client->fd, &event);
+        client->wantsWrite = wantsWrite;
+    }
+    return true;
+}
+
+// Queues a message for one viewer, dropping the viewer if its backlog is full.
+inline bool spectatorEnqueue(SpectatorServer* server, int index, const unsigned char* data, int length) {
+    SpectatorClient* client = server->clients[index];
+    if (client->size + length > SPECTATOR_QUEUE_BYTES) {
+        server->stats.dropped++;
+        spectatorCloseClient(server, index);
+        return false;
+    }
+    int tail = (client->head + client->size) % SPECTATOR_QUEUE_BYTES;
+    int first = length;
+    if (tail + first > SPECTATOR_QUEUE_BYTES) {
+        first = SPECTATOR_QUEUE_BYTES - tail;
+    }
+    memcpy(client->queue + tail, data, first);
+    memcpy(client->queue, data + first, length - first);
+    client->size += length;
+    return true;
+}
+
+inline void spectatorAccept(SpectatorServer* server, int listenFd) {
+    int fd;
+    while ((fd = accept4(listenFd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0) {
+        int index = 0;
+        while (index < SPECTATOR_MAX_CLIENTS && server->clients[index] != NULL) {
+            index++;
+        }
+        SpectatorClient* client = index < SPECTATOR_MAX_CLIENTS ? (SpectatorClient*)malloc(sizeof(SpectatorClient)) : NULL;
+        if (client == NULL) {
+            close(fd);
+            continue;
+        }
+
+        int noDelay = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+
+        client->fd = fd;
+        client->needsKeyframe = true;
+        client->wantsWrite = false;
+        client->head = 0;
+        client->size = 0;
+        server->clients[index] = client;
+
+        struct epoll_event event;
+        event.events = EPOLLIN | EPOLLRDHUP;
+        event.data.u64 = index;
+        epoll_ctl(server->epollFd, EPOLL_CTL_ADD, fd, &event);
+        server->stats.clients++;
+        server->stats.accepted++;
+    }
+}
+
+inline void spectatorBroadcast(SpectatorServer* server, const SpectatorFrame* frame) {
+    unsigned char keyframe[SPECTATOR_MAX_MESSAGE];
+    unsigned char delta[SPECTATOR_MAX_MESSAGE];
+    int keyframeLength = spectatorEncodeKeyframe(frame, keyframe);
+    int deltaLength = 0;
+
+    bool periodicKeyframe = ++server->sinceKeyframe >= SPECTATOR_KEYFRAME_INTERVAL;
+    if (periodicKeyframe) {
+        server->sinceKeyframe = 0;
+    } else {
+        deltaLength = spectatorEncodeDelta(&server->last, frame, delta);
+    }
+
+    for (int i = 0; i < SPECTATOR_MAX_CLIENTS; ++i) {
+        SpectatorClient* client = server->clients[i];
+        if (client == NULL) {
+            continue;
+        }
+        bool sendKeyframe = periodicKeyframe || client->needsKeyframe;
+        client->needsKeyframe = false;
+        if (sendKeyframe ? spectatorEnqueue(server, i, keyframe, keyframeLength)
+                         : spectatorEnqueue(server, i, delta, deltaLength)) {
+            if (!server->clients[i]->wantsWrite) {
+                spectatorFlush(server, i);
+            }
+        }
+    }
+
+    server->last = *frame;
+    server->stats.broadcasts++;
+}
+
+inline int spectatorThread(void* data) {
+    SpectatorServer* server = (SpectatorServer*)data;
+    struct epoll_event events[64];
+
+    for (;;) {
+        int count = epoll_wait(server->epollFd, events, 64, -1);
+        if (count < 0 && errno != EINTR) {
+            std::cout << "Spectator epoll Error: " << strerror(errno) << std::endl;
+            break;
+        }
+
+        for (int i = 0; i < count; ++i) {
+            Uint64 tag = events[i].data.u64;
+            if (tag == SPECTATOR_TAG_WAKE) {
+                Uint64 ignored;
+                ssize_t unused = read(server->wakeFd, &ignored, sizeof(ignored));
+                (void)unused;
+            } else if (tag == SPECTATOR_TAG_TCP) {
+                spectatorAccept(server, server->tcpFd);
+            } else if (tag == SPECTATOR_TAG_UNIX) {
+                spectatorAccept(server, server->unixFd);
+            } else if (server->clients[tag] != NULL) {
+                if (events[i].events & (EPOLLERR | EPOLLHUP | EPOLLRDHUP)) {
+                    spectatorCloseClient(server, (int)tag);
+                    continue;
+                }
+                if (events[i].events & EPOLLIN) {
+                    // Viewers never send anything meaningful; discard it
+                    unsigned char discard[256];
+                    while (recv(server->clients[tag]->fd, discard, sizeof(discard), MSG_DONTWAIT) > 0) {
+                    }
+                }
+                if (events[i].events & EPOLLOUT) {
+                    spectatorFlush(server, (int)tag);
+                }
+            }
+        }
+
+        if (SDL_AtomicGet(&server->stopping)) {
+            break;
+        }
+        if (tripleBufferAcquire(&server->handoff)) {
+            spectatorBroadcast(server, &server->slots[server->handoff.front]);
+        }
+    }
+    return 0;
+}
+
+inline int spectatorListen(SpectatorServer* server, int domain, const struct sockaddr* address, socklen_t length, Uint64 tag) {
+    int fd = socket(domain, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        std::cout << "Spectator Socket Error: " << strerror(errno) << std::endl;
+        return -1;
+    }
+    int reuse = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    if (bind(fd, address, length) != 0 || listen(fd, 128) != 0) {
+        std::cout << "Spectator Listen Error: " << strerror(errno) << std::endl;
+        close(fd);
+        return -1;
+    }
+
+    struct epoll_event event;
+    event.events = EPOLLIN;
+    event.data.u64 = tag;
+    epoll_ctl(server->epollFd, EPOLL_CTL_ADD, fd, &event);
+    return fd;
+}
+
+inline void spectatorStop(SpectatorServer* server) {
+    if (server->thread != NULL) {
+        SDL_AtomicSet(&server->stopping, 1);
+        Uint64 one = 1;
+        ssize_t unused = write(server->wakeFd, &one, sizeof(one));
+        (void)unused;
+        SDL_WaitThread(server->thread, NULL);
+        server->thread = NULL;
+    }
+
+    for (int i = 0; i < SPECTATOR_MAX_CLIENTS; ++i) {
+        if (server->clients[i] != NULL) {
+            spectatorCloseClient(server, i);
+        }
+    }
+    if (server->tcpFd >= 0) {
+        close(server->tcpFd);
+    }
+    if (server->unixFd >= 0) {
+        close(server->unixFd);
+        unlink(server->unixPath);
+    }
+    if (server->wakeFd >= 0) {
+        close(server->wakeFd);
+    }
+    if (server->epollFd >= 0) {
+        close(server->epollFd);
+    }
+    server->tcpFd = server->unixFd = server->wakeFd = server->epollFd = -1;
+}
+
+// Starts listening on a TCP port (0 for none) and/or a Unix socket path (NULL
+// for none). The stream is unauthenticated, so the TCP port only accepts
+// viewers on this machine unless allowRemote is set.
+inline bool spectatorStart(SpectatorServer* server, int tcpPort, bool allowRemote, const char* unixPath) {
+    memset(server, 0, sizeof(*server));
+    server->tcpFd = server->unixFd = server->wakeFd = -1;
+    server->epollFd = epoll_create1(EPOLL_CLOEXEC);
+    server->wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    tripleBufferInit(&server->handoff);
+    if (server->epollFd < 0 || server->wakeFd < 0) {
+        std::cout << "Spectator Init Error: " << strerror(errno) << std::endl;
+        spectatorStop(server);
+        return false;
+    }
+
+    struct epoll_event event;
+    event.events = EPOLLIN;
+    event.data.u64 = SPECTATOR_TAG_WAKE;
+    epoll_ctl(server->epollFd, EPOLL_CTL_ADD, server->wakeFd, &event);
+
+    if (tcpPort > 0) {
+        struct sockaddr_in address;
+        memset(&address, 0, sizeof(address));
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(allowRemote ? INADDR_ANY : INADDR_LOOPBACK);
+        address.sin_port = htons(tcpPort);
+        server->tcpFd = spectatorListen(server, AF_INET, (struct sockaddr*)&address, sizeof(address), SPECTATOR_TAG_TCP);
+        if (server->tcpFd < 0) {
+            spectatorStop(server);
+            return false;
+        }
+    }
+
+    if (unixPath != NULL) {
+        struct sockaddr_un address;
+        memset(&address, 0, sizeof(address));
+        address.sun_family = AF_UNIX;
+        strncpy(address.sun_path, unixPath, sizeof(address.sun_path) - 1);
+        strncpy(server->unixPath, unixPath, sizeof(server->unixPath) - 1);
+        unlink(unixPath);
+        server->unixFd = spectatorListen(server, AF_UNIX, (struct sockaddr*)&address, sizeof(address), SPECTATOR_TAG_UNIX);
+        if (server->unixFd < 0) {
+            spectatorStop(server);
+            return false;
+        }
+    }
+
+    server->thread = SDL_CreateThread(spectatorThread, "spectator", server);
+    if (server->thread == NULL) {
+        std::cout << "Spectator Thread Error: " << SDL_GetError() << std::endl;
+        spectatorStop(server);
+        return false;
+    }
+    return true;
+}
+
+// Called from the game loop once per step. Only copies the frame and wakes
+// the server thread; encoding and socket writes happen off the game thread.
+// If the server has not picked up the previous frame yet it is replaced, and
+// the next delta simply spans both steps.
+inline void spectatorPublish(SpectatorServer* server, const SpectatorFrame* frame) {
+    Uint64 begin = SDL_GetPerformanceCounter();
+
+    server->slots[server->handoff.back] = *frame;
+    tripleBufferPublish(&server->handoff);
+    Uint64 one = 1;
+    ssize_t unused = write(server->wakeFd, &one, sizeof(one));
+    (void)unused;
+
+    double elapsed = (double)(SDL_GetPerformanceCounter() - begin) * 1000.0 / SDL_GetPerformanceFrequency();
+    server->stats.publishes++;
+    server->stats.totalPublishMs += elapsed;
+    if (elapsed > server->stats.maxPublishMs) {
+        server->stats.maxPublishMs = elapsed;
+    }
+}
+
+inline void spectatorPrintStats(const SpectatorServer* server) {
+    const SpectatorStats* stats = &server->stats;
+    std::cout << "Spectators: " << stats->accepted << " accepted, " << stats->dropped << " dropped, "
+              << stats->broadcasts << " broadcasts, " << stats->bytesSent << " bytes sent, "
+              << "publish avg " << (stats->publishes ? stats->totalPublishMs / stats->publishes : 0.0) << " ms, "
+              << "max " << stats->maxPublishMs << " ms" << std::endl;
+}
+
+#endif
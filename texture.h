@@ -0,0 +1,270 @@
+#ifndef TEXTURE_H
+#define TEXTURE_H
+
+// Texture cache with handles, reference counts and a VRAM budget.
+//
+// Game code holds a TextureHandle instead of an SDL_Texture* and looks the
+// texture up each time it draws. A texture stays resident while anything
+// holds a reference. Once released it stays cached, but whenever resident
+// memory is over budget the least recently used unreferenced textures are
+// destroyed. Looking up an evicted handle loads the file again. Handles
+// stay valid until the cache is destroyed. Render thread only, apart from
+// the image decoding textureCachePreload() hands to the job system.
+
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_image.h>
+#include <iostream>
+#include <stdio.h>
+#include <string.h>
+#include "jobs.h"
+
+#define TEXTURE_MAX 32
+#define TEXTURE_NAME_LENGTH 64
+#define TEXTURE_INVALID -1
+
+typedef int TextureHandle;
+
+typedef struct {
+    char file[TEXTURE_NAME_LENGTH];
+    SDL_Texture* texture;   // NULL while evicted
+    int refCount;
+    int bytes;              // estimated VRAM, width * height * 4
+    Uint64 lastUsed;
+} TextureEntry;
+
+typedef struct {
+    SDL_Renderer* renderer;
+    TextureEntry entries[TEXTURE_MAX];
+    int count;
+    int budgetBytes;
+    int residentBytes;
+    int peakBytes;
+    Uint64 clock;           // advanced on every lookup, for LRU order
+    int loads;
+    int reloads;            // loads of a texture that had been evicted
+    int evictions;
+    int failures;
+} TextureCache;
+
+inline void textureCacheInit(TextureCache* cache, SDL_Renderer* renderer, int budgetBytes) {
+    memset(cache, 0, sizeof(*cache));
+    cache->renderer = renderer;
+    cache->budgetBytes = budgetBytes;
+}
+
+inline int textureResidentCount(const TextureCache* cache) {
+    int resident = 0;
+    for (int i = 0; i < cache->count; ++i) {
+        resident += cache->entries[i].texture != NULL;
+    }
+    return resident;
+}
+
+inline void textureEvict(TextureCache* cache, TextureEntry* entry) {
+    SDL_DestroyTexture(entry->texture);
+    entry->texture = NULL;
+    cache->residentBytes -= entry->bytes;
+    cache->evictions++;
+}
+
+// Evicts unreferenced textures, oldest first, until resident memory fits the
+// budget. Referenced textures are never evicted, so the cache can stay over
+// budget if everything resident is in use.
+inline void textureCacheFit(TextureCache* cache) {
+    while (cache->residentBytes > cache->budgetBytes) {
+        TextureEntry* oldest = NULL;
+        for (int i = 0; i < cache->count; ++i) {
+            TextureEntry* entry = &cache->entries[i];
+            if (entry->texture != NULL && entry->refCount == 0 && (oldest == NULL || entry->lastUsed < oldest->lastUsed)) {
+                oldest = entry;
+            }
+        }
+        if (oldest == NULL) {
+            return;
+        }
+        textureEvict(cache, oldest);
+    }
+}
+
+// Evicts every unreferenced texture, whatever the budget. For scene changes,
+// where the textures the old scene released will not be drawn for a while.
+inline void textureCacheTrim(TextureCache* cache) {
+    for (int i = 0; i < cache->count; ++i) {
+        TextureEntry* entry = &cache->entries[i];
+        if (entry->texture != NULL && entry->refCount == 0) {
+            textureEvict(cache, entry);
+        }
+    }
+}
+
+// Creates the texture for an entry from a decoded image, and frees the image.
+inline bool textureUpload(TextureCache* cache, TextureEntry* entry, SDL_Surface* surface) {
+    entry->texture = SDL_CreateTextureFromSurface(cache->renderer, surface);
+    SDL_FreeSurface(surface);
+    if (entry->texture == NULL) {
+        std::cout << "Image Load Texture Error: " << SDL_GetError() << std::endl;
+        cache->failures++;
+        return false;
+    }
+
+    int width, height;
+    SDL_QueryTexture(entry->texture, NULL, NULL, &width, &height);
+    if (entry->bytes != 0) {
+        cache->reloads++;
+    }
+    entry->bytes = width * height * 4;
+    entry->lastUsed = ++cache->clock;
+    cache->residentBytes += entry->bytes;
+    if (cache->residentBytes > cache->peakBytes) {
+        cache->peakBytes = cache->residentBytes;
+    }
+    cache->loads++;
+    return true;
+}
+
+inline bool textureLoad(TextureCache* cache, TextureEntry* entry) {
+    SDL_Surface* surface = IMG_Load(entry->file);
+    if (surface == NULL) {
+        std::cout << "Image Load Texture Error: " << IMG_GetError() << std::endl;
+        cache->failures++;
+        return false;
+    }
+    return textureUpload(cache, entry, surface);
+}
+
+// The handle for file, adding an entry for it if there is none yet and add
+// is set. TEXTURE_INVALID if it is not found or the cache is full.
+inline TextureHandle textureLookup(TextureCache* cache, const char* file, bool add) {
+    for (int i = 0; i < cache->count; ++i) {
+        if (strcmp(cache->entries[i].file, file) == 0) {
+            return i;
+        }
+    }
+    if (!add) {
+        return TEXTURE_INVALID;
+    }
+    if (cache->count >= TEXTURE_MAX || strlen(file) >= TEXTURE_NAME_LENGTH) {
+        std::cout << "Texture Cache Error: cannot add " << file << std::endl;
+        return TEXTURE_INVALID;
+    }
+    TextureEntry* entry = &cache->entries[cache->count];
+    memset(entry, 0, sizeof(*entry));
+    strcpy(entry->file, file);
+    return cache->count++;
+}
+
+typedef struct {
+    const char* const* files;
+    SDL_Surface** surfaces;
+} TextureDecodeBatch;
+
+inline void textureDecodeJob(void* data, int begin, int end) {
+    TextureDecodeBatch* batch = (TextureDecodeBatch*)data;
+    for (int i = begin; i < end; ++i) {
+        batch->surfaces[i] = IMG_Load(batch->files[i]);
+    }
+}
+
+// Decodes several images at once on the job system, then creates their
+// textures on this thread. They stay cached, unreferenced, for textureAcquire().
+// Files that fail here are left for textureAcquire() to load and report.
+inline void textureCachePreload(TextureCache* cache, JobSystem* jobs, const char* const* files, int count) {
+    SDL_Surface* surfaces[TEXTURE_MAX];
+    if (count > TEXTURE_MAX) {
+        count = TEXTURE_MAX;
+    }
+    TextureDecodeBatch batch = {files, surfaces};
+    JobCounter decoded = {};
+    jobParallelFor(jobs, textureDecodeJob, &batch, count, 1, &decoded);
+    jobWait(jobs, &decoded);
+
+    for (int i = 0; i < count; ++i) {
+        if (surfaces[i] == NULL) {
+            continue;
+        }
+        TextureHandle handle = textureLookup(cache, files[i], true);
+        if (handle == TEXTURE_INVALID || cache->entries[handle].texture != NULL) {
+            SDL_FreeSurface(surfaces[i]);
+            continue;
+        }
+        textureUpload(cache, &cache->entries[handle], surfaces[i]);
+    }
+    textureCacheFit(cache);
+}
+
+// Takes a reference to the texture for file, loading it if needed. Returns
+// TEXTURE_INVALID if the file cannot be loaded.
+inline TextureHandle textureAcquire(TextureCache* cache, const char* file) {
+    TextureHandle handle = textureLookup(cache, file, true);
+    if (handle == TEXTURE_INVALID) {
+        return TEXTURE_INVALID;
+    }
+
+    TextureEntry* entry = &cache->entries[handle];
+    if (entry->texture == NULL && !textureLoad(cache, entry)) {
+        return TEXTURE_INVALID;
+    }
+    entry->refCount++;
+    textureCacheFit(cache);
+    return handle;
+}
+
+inline void textureRetain(TextureCache* cache, TextureHandle handle) {
+    if (handle >= 0 && handle < cache->count) {
+        cache->entries[handle].refCount++;
+    }
+}
+
+// Drops a reference. The texture stays cached until the budget needs the room.
+inline void textureRelease(TextureCache* cache, TextureHandle handle) {
+    if (handle >= 0 && handle < cache->count && cache->entries[handle].refCount > 0) {
+        cache->entries[handle].refCount--;
+        textureCacheFit(cache);
+    }
+}
+
+// The texture to draw with, reloaded first if it was evicted. NULL if the
+// handle is invalid or the reload fails.
+inline SDL_Texture* textureGet(TextureCache* cache, TextureHandle handle) {
+    if (handle < 0 || handle >= cache->count) {
+        return NULL;
+    }
+    TextureEntry* entry = &cache->entries[handle];
+    if (entry->texture == NULL) {
+        if (!textureLoad(cache, entry)) {
+            return NULL;
+        }
+        // Make room by evicting others, never the texture about to be drawn
+        entry->refCount++;
+        textureCacheFit(cache);
+        entry->refCount--;
+    }
+    entry->lastUsed = ++cache->clock;
+    return entry->texture;
+}
+
+// One line for the debug overlay.
+inline void textureCacheDescribe(const TextureCache* cache, char* text, int size) {
+    snprintf(text, size, "Textures: %d of %d resident, %d KB of %d KB budget (peak %d KB), %d loads, %d reloads, %d evictions",
+             textureResidentCount(cache), cache->count, cache->residentBytes / 1024, cache->budgetBytes / 1024,
+             cache->peakBytes / 1024, cache->loads, cache->reloads, cache->evictions);
+}
+
+inline void textureCachePrintStats(const TextureCache* cache) {
+    char text[256];
+    textureCacheDescribe(cache, text, sizeof(text));
+    std::cout << text << ", " << cache->failures << " failed loads" << std::endl;
+}
+
+inline void textureCacheDestroy(TextureCache* cache) {
+    for (int i = 0; i < cache->count; ++i) {
+        if (cache->entries[i].texture != NULL) {
+            SDL_DestroyTexture(cache->entries[i].texture);
+            cache->entries[i].texture = NULL;
+        }
+    }
+    cache->residentBytes = 0;
+    cache->count = 0;
+}
+
+#endif
@@ -0,0 +1,43 @@
+#ifndef TRIPLEBUFFER_H
+#define TRIPLEBUFFER_H
+
+// Lock-free triple buffer index for handing the newest value from one
+// producer thread to one consumer thread.
+//
+// The caller owns three slots of the value type. The producer always writes
+// slots[back] and then publishes it; the consumer reads slots[front] after
+// acquiring. Neither side ever waits, and the consumer always gets the most
+// recently published slot, skipping any it was too slow to see.
+
+#include <SDL2/SDL.h>
+
+#define TRIPLEBUFFER_FRESH 4  // set on the shared index until the consumer takes it
+
+typedef struct {
+    SDL_atomic_t shared;  // slot index in the middle, | TRIPLEBUFFER_FRESH when unread
+    int back;             // producer's slot
+    int front;            // consumer's slot
+} TripleBuffer;
+
+inline void tripleBufferInit(TripleBuffer* buffer) {
+    buffer->back = 0;
+    buffer->front = 1;
+    SDL_AtomicSet(&buffer->shared, 2);
+}
+
+// Hands slots[back] to the consumer; back then names the slot to write next.
+inline void tripleBufferPublish(TripleBuffer* buffer) {
+    buffer->back = SDL_AtomicSet(&buffer->shared, buffer->back | TRIPLEBUFFER_FRESH) & ~TRIPLEBUFFER_FRESH;
+}
+
+// Moves front to the newest published slot. Returns false, leaving front
+// unchanged, if nothing was published since the last call.
+inline bool tripleBufferAcquire(TripleBuffer* buffer) {
+    if (!(SDL_AtomicGet(&buffer->shared) & TRIPLEBUFFER_FRESH)) {
+        return false;
+    }
+    buffer->front = SDL_AtomicSet(&buffer->shared, buffer->front) & ~TRIPLEBUFFER_FRESH;
+    return true;
+}
+
+#endif
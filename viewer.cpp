@@ -0,0 +1,278 @@
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_image.h>
+#include <SDL2/SDL_ttf.h>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <netdb.h>
+#include "spectator.h"
+
+// Spectator viewer for a game started with --spectate-port or --spectate-socket.
+//
+//   ./viewer <host> <port>              watch over TCP
+//   ./viewer --socket <path>            watch over a Unix socket
+//   ./viewer --load <count> <host> <port> [seconds]
+//                                       headless load test with many subscribers;
+//                                       checks delivery only, the cost to the game
+//                                       is measured by ./dino --bench-spectators
+
+#define WINDOW_WIDTH 1000
+#define WINDOW_HEIGHT 700
+#define GROUND_HEIGHT 120
+#define STREAM_BUFFER 8192
+
+typedef struct {
+    int fd;
+    unsigned char buffer[STREAM_BUFFER];
+    int length;
+    SpectatorFrame frame;
+    int messages;
+    bool connected;
+} Stream;
+
+int connectTcp(const char* host, const char* port) {
+    struct addrinfo hints;
+    struct addrinfo* result = NULL;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    if (getaddrinfo(host, port, &hints, &result) != 0 || result == NULL) {
+        std::cout << "Resolve Error: " << host << std::endl;
+        return -1;
+    }
+
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd >= 0 && connect(fd, result->ai_addr, result->ai_addrlen) != 0) {
+        close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(result);
+    if (fd < 0) {
+        std::cout << "Connect Error: " << strerror(errno) << std::endl;
+    }
+    return fd;
+}
+
+int connectUnix(const char* path) {
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strncpy(address.sun_path, path, sizeof(address.sun_path) - 1);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd >= 0 && connect(fd, (struct sockaddr*)&address, sizeof(address)) != 0) {
+        close(fd);
+        fd = -1;
+    }
+    if (fd < 0) {
+        std::cout << "Connect Error: " << strerror(errno) << std::endl;
+    }
+    return fd;
+}
+
+void openStream(Stream* stream, int fd) {
+    memset(stream, 0, sizeof(*stream));
+    stream->fd = fd;
+    stream->connected = fd >= 0;
+    if (stream->connected) {
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+    }
+}
+
+// Reads whatever has arrived and applies every complete message.
+void pumpStream(Stream* stream) {
+    while (stream->connected) {
+        ssize_t received = recv(stream->fd, stream->buffer + stream->length, STREAM_BUFFER - stream->length, 0);
+        if (received == 0 || (received < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+            stream->connected = false;
+            break;
+        }
+        if (received < 0) {
+            break;
+        }
+        stream->length += received;
+
+        int offset = 0;
+        int used;
+        while ((used = spectatorDecode(stream->buffer + offset, stream->length - offset, &stream->frame)) > 0) {
+            offset += used;
+            stream->messages++;
+        }
+        if (used < 0) {
+            std::cout << "Corrupt spectator stream" << std::endl;
+            stream->connected = false;
+            break;
+        }
+        memmove(stream->buffer, stream->buffer + offset, stream->length - offset);
+        stream->length -= offset;
+    }
+}
+
+int runLoadTest(int count, const char* host, const char* port, int seconds) {
+    std::vector<Stream> streams(count);
+    for (int i = 0; i < count; ++i) {
+        openStream(&streams[i], connectTcp(host, port));
+        if (!streams[i].connected) {
+            std::cout << "Only " << i << " subscribers connected" << std::endl;
+            count = i;
+            break;
+        }
+    }
+
+    int epollFd = epoll_create1(0);
+    for (int i = 0; i < count; ++i) {
+        struct epoll_event event;
+        event.events = EPOLLIN;
+        event.data.u32 = i;
+        epoll_ctl(epollFd, EPOLL_CTL_ADD, streams[i].fd, &event);
+    }
+
+    Uint64 frequency = SDL_GetPerformanceFrequency();
+    Uint64 end = SDL_GetPerformanceCounter() + frequency * seconds;
+    struct epoll_event events[256];
+    while (SDL_GetPerformanceCounter() < end) {
+        int ready = epoll_wait(epollFd, events, 256, 100);
+        for (int i = 0; i < ready; ++i) {
+            Stream* stream = &streams[events[i].data.u32];
+            pumpStream(stream);
+            if (!stream->connected) {
+                epoll_ctl(epollFd, EPOLL_CTL_DEL, stream->fd, NULL);
+            }
+        }
+    }
+
+    int connected = 0;
+    int minMessages = count > 0 ? streams[0].messages : 0;
+    int maxMessages = 0;
+    for (int i = 0; i < count; ++i) {
+        connected += streams[i].connected;
+        if (streams[i].messages < minMessages) minMessages = streams[i].messages;
+        if (streams[i].messages > maxMessages) maxMessages = streams[i].messages;
+        close(streams[i].fd);
+    }
+    close(epollFd);
+
+    std::cout << "Load test: " << count << " subscribers, " << connected << " still connected after "
+              << seconds << " s, messages per subscriber " << minMessages << ".." << maxMessages << std::endl;
+    return 0;
+}
+
+void renderFrame(SDL_Renderer* renderer, const SpectatorFrame* frame, SDL_Texture* dinoTexture, SDL_Texture* ghostTexture, TTF_Font* font) {
+    SDL_SetRenderDrawColor(renderer, 135, 206, 235, 255);
+    SDL_RenderClear(renderer);
+
+    SDL_SetRenderDrawColor(renderer, 34, 139, 34, 255);
+    SDL_Rect grassRect = {0, WINDOW_HEIGHT - GROUND_HEIGHT, WINDOW_WIDTH, GROUND_HEIGHT / 2};
+    SDL_RenderFillRect(renderer, &grassRect);
+
+    SDL_SetRenderDrawColor(renderer, 139, 69, 19, 255);
+    SDL_Rect soilRect = {0, WINDOW_HEIGHT - GROUND_HEIGHT / 2, WINDOW_WIDTH, GROUND_HEIGHT / 2};
+    SDL_RenderFillRect(renderer, &soilRect);
+
+    int numPlayers = frame->values[SPEC_NUM_PLAYERS];
+    for (int i = 0; i < numPlayers && i < SPEC_MAX_DINOS; ++i) {
+        const Sint32* fields = &frame->values[SPEC_DINO(i)];
+        SDL_Rect dinoRect = {fields[0], fields[1], fields[2], fields[3]};
+        if (i > 0) {
+            SDL_SetTextureColorMod(dinoTexture, 255, 160, 160);
+        }
+        SDL_RenderCopy(renderer, dinoTexture, NULL, &dinoRect);
+        if (i > 0) {
+            SDL_SetTextureColorMod(dinoTexture, 255, 255, 255);
+        }
+    }
+
+    const Sint32* ghost = &frame->values[SPEC_GHOST];
+    if (ghost[4]) {
+        SDL_Rect ghostRect = {ghost[0], ghost[1], ghost[2], ghost[3]};
+        SDL_RenderCopy(renderer, ghostTexture, NULL, &ghostRect);
+    }
+
+    if (font != NULL) {
+        SDL_Color White = {255, 255, 255, 255};
+        SDL_Surface* surfaceMessage = TTF_RenderText_Solid(font, ("Score: " + std::to_string(frame->values[SPEC_SCORE])).c_str(), White);
+        if (surfaceMessage != NULL) {
+            SDL_Texture* Message = SDL_CreateTextureFromSurface(renderer, surfaceMessage);
+            SDL_Rect Message_rect = {20, 20, 100, 50};
+            SDL_RenderCopy(renderer, Message, NULL, &Message_rect);
+            SDL_FreeSurface(surfaceMessage);
+            SDL_DestroyTexture(Message);
+        }
+    }
+
+    SDL_RenderPresent(renderer);
+}
+
+int main(int argc, char* argv[]) {
+    if (argc >= 5 && strcmp(argv[1], "--load") == 0) {
+        return runLoadTest(atoi(argv[2]), argv[3], argv[4], argc >= 6 ? atoi(argv[5]) : 10);
+    }
+
+    int fd;
+    if (argc >= 3 && strcmp(argv[1], "--socket") == 0) {
+        fd = connectUnix(argv[2]);
+    } else if (argc >= 3) {
+        fd = connectTcp(argv[1], argv[2]);
+    } else {
+        std::cout << "Usage: " << argv[0] << " <host> <port> | --socket <path> | --load <count> <host> <port> [seconds]" << std::endl;
+        return 1;
+    }
+    if (fd < 0) {
+        return 1;
+    }
+
+    Stream stream;
+    openStream(&stream, fd);
+
+    if (SDL_Init(SDL_INIT_VIDEO) != 0) {
+        std::cout << "SDL Init Error: " << SDL_GetError() << std::endl;
+        return 1;
+    }
+    SDL_Window* window = SDL_CreateWindow("Jumping Dino - Spectator", SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, WINDOW_WIDTH, WINDOW_HEIGHT, 0);
+    SDL_Renderer* renderer = window ? SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC) : NULL;
+    if (renderer == NULL || !(IMG_Init(IMG_INIT_PNG) & IMG_INIT_PNG) || TTF_Init() == -1) {
+        std::cout << "Viewer Init Error: " << SDL_GetError() << std::endl;
+        if (window) SDL_DestroyWindow(window);
+        SDL_Quit();
+        return 1;
+    }
+
+    SDL_Texture* dinoTexture = IMG_LoadTexture(renderer, "dino.png");
+    SDL_Texture* ghostTexture = IMG_LoadTexture(renderer, "ghost.png");
+    TTF_Font* font = TTF_OpenFont("arial.ttf", 24);
+    if (dinoTexture == NULL || ghostTexture == NULL) {
+        std::cout << "Image Load Texture Error: " << IMG_GetError() << std::endl;
+    }
+
+    bool running = true;
+    while (running && stream.connected) {
+        SDL_Event event;
+        while (SDL_PollEvent(&event)) {
+            if (event.type == SDL_QUIT) {
+                running = false;
+            }
+        }
+
+        pumpStream(&stream);
+        if (stream.messages > 0) {
+            renderFrame(renderer, &stream.frame, dinoTexture, ghostTexture, font);
+        } else {
+            SDL_Delay(16);
+        }
+    }
+
+    if (!stream.connected) {
+        std::cout << "Spectator stream closed" << std::endl;
+    }
+
+    close(stream.fd);
+    if (font) TTF_CloseFont(font);
+    SDL_DestroyTexture(dinoTexture);
+    SDL_DestroyTexture(ghostTexture);
+    SDL_DestroyRenderer(renderer);
+    SDL_DestroyWindow(window);
+    TTF_Quit();
+    IMG_Quit();
+    SDL_Quit();
+    return 0;
+}